@@ -0,0 +1,56 @@
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "start_tasks.h"
+#include "thread_pool.h"
+#include "wait_tasks.h"
+
+
+extern int g_thread_num;
+extern coros::ThreadPoolOptions g_pool_options;
+
+namespace {
+
+coros::Task<long> fanout_leaf(int index) {
+  long sum = 0;
+  for (int i = 0; i < 1'000; i++) sum += (index * i) % 7;
+  co_return sum;
+}
+
+// Single task spawning a wide fan-out of children. All children land in the
+// deque of one worker, other workers have to steal all of them.
+coros::Task<long> fanout(int width) {
+  std::vector<coros::Task<long>> tasks;
+  tasks.reserve(width);
+  for (int i = 0; i < width; i++) {
+    tasks.push_back(fanout_leaf(i));
+  }
+
+  co_await coros::wait_tasks(tasks);
+
+  long sum = 0;
+  for (auto& task : tasks) sum += *task;
+  co_return sum;
+}
+
+}
+
+// Reports the time in milliseconds, the number of steal operations and
+// stolen tasks is written to standard output.
+inline int bench_workstealing_fanout() {
+  coros::ThreadPool tp{g_pool_options};
+  coros::Task<long> t = fanout(100'000);
+
+  auto start = std::chrono::high_resolution_clock::now();
+
+  coros::start_sync(tp, t);
+
+  auto end = std::chrono::high_resolution_clock::now();
+  auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+
+  std::cout << "fanout steal operations : " << tp.steal_operations()
+            << ", stolen tasks : " << tp.stolen_tasks() << std::endl;
+
+  return duration.count();
+}
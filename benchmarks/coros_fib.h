@@ -7,6 +7,7 @@
 
 
 extern int g_thread_num;
+extern coros::ThreadPoolOptions g_pool_options;
 
 inline coros::Task<long> fib(int index) {
   if (index < 2) co_return index;
@@ -21,7 +22,7 @@ inline coros::Task<long> fib(int index) {
 
 
 inline int bench_workstealing_fib() {
-  coros::ThreadPool tp{g_thread_num};
+  coros::ThreadPool tp{g_pool_options};
   coros::Task<long> t = fib(30);
 
   auto start = std::chrono::high_resolution_clock::now();
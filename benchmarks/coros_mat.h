@@ -7,6 +7,7 @@
 
 
 extern int g_thread_num;
+extern coros::ThreadPoolOptions g_pool_options;
 
 namespace {
 
@@ -53,7 +54,7 @@ int bench_workstealing_matmul() {
     }
   }
 
-  coros::ThreadPool tp{g_thread_num};
+  coros::ThreadPool tp{g_pool_options};
   coros::Task<void> t = matmul(A, B, C, N, N);
 
   auto start = std::chrono::high_resolution_clock::now();
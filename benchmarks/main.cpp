@@ -1,13 +1,21 @@
 #include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "thread_pool.h"
 
 int g_thread_num;
+coros::ThreadPoolOptions g_pool_options;
 
+#include "coros_fanout.h"
 #include "coros_fib.h"
 #include "coros_mat.h"
 
 #include "openmp_fib.h"
 #include "openmp_mat.h"
 
+#include <cstdlib>
 #include <functional>
 
 void make_test(std::string file_name, std::function<int()> bench_func) {
@@ -22,19 +30,69 @@ void make_test(std::string file_name, std::function<int()> bench_func) {
   }
 }
 
+// Pinning mode is one of none, compact, scatter, mask or an explicit
+// cpu list, for example 0-3,8. OpenMP threads are bound the same way
+// through OMP_PROC_BIND and OMP_PLACES. Modes numa and topology enable
+// NUMA or cache topology aware stealing with their default pinning.
+bool parse_pinning(std::string_view mode, coros::ThreadPoolOptions& options) {
+  if (mode == "none") {
+    options.pinning = coros::Pinning::NONE;
+  } else if (mode == "compact") {
+    options.pinning = coros::Pinning::COMPACT;
+    setenv("OMP_PROC_BIND", "close", 0);
+    setenv("OMP_PLACES", "threads", 0);
+  } else if (mode == "scatter") {
+    options.pinning = coros::Pinning::SCATTER;
+    setenv("OMP_PROC_BIND", "spread", 0);
+    setenv("OMP_PLACES", "cores", 0);
+  } else if (mode == "numa") {
+    options.numa_aware = true;
+    setenv("OMP_PROC_BIND", "spread", 0);
+    setenv("OMP_PLACES", "cores", 0);
+  } else if (mode == "topology") {
+    options.topology_aware = true;
+    setenv("OMP_PROC_BIND", "close", 0);
+    setenv("OMP_PLACES", "threads", 0);
+  } else if (mode == "mask") {
+    options.pinning = coros::Pinning::AFFINITY_MASK;
+    setenv("OMP_PROC_BIND", "true", 0);
+  } else {
+    options.pinning = coros::Pinning::CPU_LIST;
+    options.cpus = coros::detail::parse_cpu_list(std::string(mode));
+    if (options.cpus.empty()) return false;
+    std::string places;
+    for (int cpu : options.cpus) {
+      places += (places.empty() ? "{" : ",{") + std::to_string(cpu) + "}";
+    }
+    setenv("OMP_PROC_BIND", "true", 0);
+    setenv("OMP_PLACES", places.c_str(), 0);
+  }
+  return true;
+}
+
 int main(int argc, char const *argv[]) {
 
-  if (argc != 2) {
-    std::cerr << "Usage: " << argv[0] << " <integer>" << std::endl;
+  if (argc < 2 || argc > 3) {
+    std::cerr << "Usage: " << argv[0]
+              << " <integer> [none|compact|scatter|mask|numa|topology|<cpu list>]" << std::endl;
+    return 1;
   }
 
   g_thread_num = std::atoi(argv[1]);
+  g_pool_options.thread_count = g_thread_num;
+
+  std::string pinning = argc == 3 ? argv[2] : "none";
+  if (!parse_pinning(pinning, g_pool_options)) {
+    std::cerr << "Unknown pinning mode : " << pinning << std::endl;
+    return 1;
+  }
 
   make_test("openmp_fib_" + std::to_string(g_thread_num) + ".txt", bench_openmp_fib);
   make_test("openmp_matmul_" + std::to_string(g_thread_num) + ".txt", bench_openmp_matmul);
 
   make_test("workstealing_fib_" + std::to_string(g_thread_num) + ".txt", bench_workstealing_fib);
   make_test("workstealing_matmul_" + std::to_string(g_thread_num) + ".txt", bench_workstealing_matmul);
+  make_test("workstealing_fanout_" + std::to_string(g_thread_num) + ".txt", bench_workstealing_fanout);
  
   return 0;
 }
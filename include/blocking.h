@@ -0,0 +1,90 @@
+#ifndef COROS_INCLUDE_BLOCKING_H_
+#define COROS_INCLUDE_BLOCKING_H_
+
+#include <coroutine>
+#include <exception>
+#include <expected>
+#include <functional>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+#include "blocking_threads.h"
+#include "task_life_time.h"
+#include "thread_pool.h"
+
+namespace coros {
+
+// Runs the callable on one of the blocking threads of the pool and resumes
+// the awaiting coroutine on a worker of the pool afterwards. The workers are
+// free to run other tasks while the call blocks. An exception thrown by the
+// callable is returned as the error of the result.
+template <typename F>
+class RunBlockingAwaitable {
+ public:
+  using ValueType = std::invoke_result_t<F&>;
+  using ResultType = std::expected<ValueType, std::exception_ptr>;
+
+  RunBlockingAwaitable(ThreadPool& pool, F&& callable)
+      : pool_(pool), callable_(std::move(callable)) {
+    job_.self = this;
+    job_.run = &RunBlockingAwaitable::run;
+  }
+
+  // The job is queued for a blocking thread while suspended.
+  RunBlockingAwaitable(const RunBlockingAwaitable&) = delete;
+  RunBlockingAwaitable& operator=(const RunBlockingAwaitable&) = delete;
+
+  bool await_ready() const noexcept { return false; }
+
+  void await_suspend(std::coroutine_handle<> handle) {
+    handle_ = handle;
+    pool_.run_blocking_job(job_);
+  }
+
+  ResultType await_resume() { return std::move(*result_); }
+
+ private:
+  struct Job : detail::BlockingJob {
+    RunBlockingAwaitable* self;
+  };
+
+  // Runs on a blocking thread.
+  static void run(detail::BlockingJob* job) {
+    RunBlockingAwaitable* self = static_cast<Job*>(job)->self;
+    try {
+      if constexpr (std::is_void_v<ValueType>) {
+        std::invoke(self->callable_);
+        self->result_.emplace();
+      } else {
+        self->result_.emplace(std::invoke(self->callable_));
+      }
+    } catch (...) {
+      self->result_.emplace(std::unexpected(std::current_exception()));
+    }
+    self->pool_.add_task_from_outside({self->handle_, detail::TaskLifeTime::SCOPE_MANAGED});
+  }
+
+  ThreadPool& pool_;
+  F callable_;
+  std::coroutine_handle<> handle_;
+  std::optional<ResultType> result_;
+  Job job_;
+};
+
+// co_await coros::run_blocking(callable), awaited from a worker of a pool.
+template <typename F>
+inline RunBlockingAwaitable<std::decay_t<F>> run_blocking(F&& callable) {
+  return RunBlockingAwaitable<std::decay_t<F>>{*thread_my_pool, std::decay_t<F>(std::forward<F>(callable))};
+}
+
+// Resumes the coroutine on the given pool, so it can be awaited from
+// outside of a pool as well.
+template <typename F>
+inline RunBlockingAwaitable<std::decay_t<F>> run_blocking(ThreadPool& pool, F&& callable) {
+  return RunBlockingAwaitable<std::decay_t<F>>{pool, std::decay_t<F>(std::forward<F>(callable))};
+}
+
+} // namespace coros
+
+#endif  // COROS_INCLUDE_BLOCKING_H_
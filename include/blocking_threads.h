@@ -0,0 +1,135 @@
+#ifndef COROS_INCLUDE_BLOCKING_THREADS_H_
+#define COROS_INCLUDE_BLOCKING_THREADS_H_
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace coros {
+namespace detail {
+
+// Job run on a blocking thread. The job is embedded in the awaiter of
+// run_blocking, so submitting it does not allocate.
+struct BlockingJob {
+  BlockingJob* next = nullptr;
+  void (*run)(BlockingJob*) = nullptr;
+};
+
+// Elastic set of threads for blocking calls, kept apart from the workers.
+// Threads are started when a job finds no idle thread, up to max_threads,
+// and exit after idle_timeout without work. Jobs beyond the limit wait in
+// FIFO order.
+class BlockingThreads {
+ public:
+  BlockingThreads(size_t max_threads, std::chrono::steady_clock::duration idle_timeout)
+      : max_threads_(std::max<size_t>(max_threads, 1)), idle_timeout_(idle_timeout) {}
+
+  BlockingThreads(const BlockingThreads&) = delete;
+  BlockingThreads& operator=(const BlockingThreads&) = delete;
+
+  ~BlockingThreads() { stop(); }
+
+  void submit(BlockingJob* job) {
+    std::unique_lock lock(mutex_);
+    if (stop_) {
+      // No thread takes the job anymore, it runs on the caller instead, so
+      // its awaiter is still resumed.
+      lock.unlock();
+      job->run(job);
+      return;
+    }
+    job->next = nullptr;
+    if (tail_ != nullptr) {
+      tail_->next = job;
+    } else {
+      head_ = job;
+    }
+    tail_ = job;
+    queued_++;
+    if (idle_ < queued_ && live_ < max_threads_) {
+      reap();
+      live_++;
+      threads_.emplace_back([this]() { run(); });
+    } else {
+      cv_.notify_one();
+    }
+  }
+
+  // Runs the queued jobs and waits for them. Jobs submitted afterwards run on
+  // the submitting thread.
+  void stop() {
+    {
+      std::lock_guard lock(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto& thread : threads_) {
+      if (thread.joinable()) thread.join();
+    }
+    threads_.clear();
+  }
+
+  // Number of running threads, busy or idle.
+  size_t thread_count() {
+    std::lock_guard lock(mutex_);
+    return live_;
+  }
+
+ private:
+  void run() {
+    std::unique_lock lock(mutex_);
+    while (true) {
+      idle_++;
+      bool has_work = cv_.wait_for(lock, idle_timeout_, [this]() { return stop_ || head_ != nullptr; });
+      idle_--;
+      // Threads exit after the idle timeout or, once stopped, after the
+      // queue is drained.
+      if (!has_work || head_ == nullptr) break;
+      BlockingJob* job = head_;
+      head_ = job->next;
+      if (head_ == nullptr) tail_ = nullptr;
+      queued_--;
+      lock.unlock();
+      job->run(job);
+      lock.lock();
+    }
+    live_--;
+    exited_.push_back(std::this_thread::get_id());
+  }
+
+  // Joins threads that exited after their idle timeout. The mutex is held.
+  void reap() {
+    for (auto id : exited_) {
+      auto it = std::find_if(threads_.begin(), threads_.end(),
+                             [id](const std::thread& thread) { return thread.get_id() == id; });
+      if (it == threads_.end()) continue;
+      it->join();
+      threads_.erase(it);
+    }
+    exited_.clear();
+  }
+
+  size_t max_threads_;
+  std::chrono::steady_clock::duration idle_timeout_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  // Queue of submitted jobs.
+  BlockingJob* head_ = nullptr;
+  BlockingJob* tail_ = nullptr;
+  size_t queued_ = 0;
+  size_t idle_ = 0;
+  size_t live_ = 0;
+  bool stop_ = false;
+  std::vector<std::thread> threads_;
+  // Threads that left run() and can be joined.
+  std::vector<std::thread::id> exited_;
+};
+
+} // namespace detail
+} // namespace coros
+
+#endif  // COROS_INCLUDE_BLOCKING_THREADS_H_
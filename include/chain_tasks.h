@@ -5,10 +5,13 @@
 #include <exception>
 #include <expected>
 #include <functional>
+#include <memory>
+#include <memory_resource>
 #include <tuple>
 #include <type_traits>
 #include <utility>
 
+#include "frame_allocator.h"
 #include "task.h"
 
 namespace coros {
@@ -49,25 +52,25 @@ concept IsNotTask = !is_Task<T>::value;
 
 template<typename T, typename U, typename F, typename... Funcs>
 requires (!FunctionNoParams<F> && IsNotTask<U>)
-coros::Task<T> process_tasks(U val, F f, Funcs... functions);
+coros::Task<T> process_tasks(std::allocator_arg_t, FrameAllocatorRef allocator, U val, F f, Funcs... functions);
 
 template<typename T, IsNotTask U, typename F>
 requires (!FunctionNoParams<F> && IsNotTask<U>)
-coros::Task<T> process_tasks(U val, F f);
+coros::Task<T> process_tasks(std::allocator_arg_t, FrameAllocatorRef, U val, F f);
 
 template<typename... Funcs>
-coros::Task<void> process_tasks(coros::Task<void>(*f)(), Funcs... functions);
+coros::Task<void> process_tasks(std::allocator_arg_t, FrameAllocatorRef allocator, coros::Task<void>(*f)(), Funcs... functions);
 
-inline coros::Task<void> process_tasks(coros::Task<void>(*f)());
+inline coros::Task<void> process_tasks(std::allocator_arg_t, FrameAllocatorRef, coros::Task<void>(*f)());
 
 template<typename... Funcs>
-coros::Task<void> process_tasks(coros::Task<void>(*f)());
+coros::Task<void> process_tasks(std::allocator_arg_t, FrameAllocatorRef, coros::Task<void>(*f)());
 
 template<typename T, typename U, typename... Funcs>
-coros::Task<T> process_tasks(coros::Task<U>& starting_task, Funcs... functions);
+coros::Task<T> process_tasks(std::allocator_arg_t, FrameAllocatorRef allocator, coros::Task<U>& starting_task, Funcs... functions);
 
 template<typename T, typename U>
-coros::Task<T> process_tasks(coros::Task<U>& starting_task);
+coros::Task<T> process_tasks(std::allocator_arg_t, FrameAllocatorRef, coros::Task<U>& starting_task);
 
 //
 // Function definitions.
@@ -75,7 +78,7 @@ coros::Task<T> process_tasks(coros::Task<U>& starting_task);
 
 template<typename T, typename U, typename F, typename... Funcs>
 requires (!FunctionNoParams<F> && IsNotTask<U>)
-coros::Task<T> process_tasks(U val, F f, Funcs... functions) {
+coros::Task<T> process_tasks(std::allocator_arg_t, FrameAllocatorRef allocator, U val, F f, Funcs... functions) {
 
   // Extract the return type from the pointer
   using return_type = extract_return_type_t<F>;
@@ -95,7 +98,7 @@ coros::Task<T> process_tasks(U val, F f, Funcs... functions) {
   
   // TODO : Do not like this, should be more readable.
   if constexpr (std::is_void_v<return_type>) {
-    auto next_task = coros::detail::process_tasks(functions...);
+    auto next_task = coros::detail::process_tasks(std::allocator_arg, allocator, functions...);
     co_await next_task;
     
     if (!next_task.has_value()) {
@@ -104,7 +107,7 @@ coros::Task<T> process_tasks(U val, F f, Funcs... functions) {
 
     co_return;
   } else {
-    auto next_task = coros::detail::process_tasks<T>(*std::move(t), functions...);
+    auto next_task = coros::detail::process_tasks<T>(std::allocator_arg, allocator, *std::move(t), functions...);
     co_await next_task;
 
     if (!next_task.has_value()) {
@@ -122,7 +125,7 @@ coros::Task<T> process_tasks(U val, F f, Funcs... functions) {
 // Base case
 template<typename T, IsNotTask U, typename F>
 requires (!FunctionNoParams<F> && IsNotTask<U>)
-coros::Task<T> process_tasks(U val, F f) {
+coros::Task<T> process_tasks(std::allocator_arg_t, FrameAllocatorRef, U val, F f) {
   // Extract the return type from the pointer
   using return_type = extract_return_type_t<F>;
   
@@ -148,7 +151,7 @@ coros::Task<T> process_tasks(U val, F f) {
 
 // TODO : Maybe fix the concept.
 template<typename... Funcs>
-coros::Task<void> process_tasks(coros::Task<void>(*f)(), Funcs... functions) {
+coros::Task<void> process_tasks(std::allocator_arg_t, FrameAllocatorRef allocator, coros::Task<void>(*f)(), Funcs... functions) {
   coros::Task<void> t = f();
   co_await t;
   
@@ -156,7 +159,7 @@ coros::Task<void> process_tasks(coros::Task<void>(*f)(), Funcs... functions) {
     std::rethrow_exception(t.error());
   }   
 
-  auto next_task = coros::detail::process_tasks(functions...);
+  auto next_task = coros::detail::process_tasks(std::allocator_arg, allocator, functions...);
   co_await next_task;
 
   if (!next_task.has_value()) {
@@ -166,7 +169,7 @@ coros::Task<void> process_tasks(coros::Task<void>(*f)(), Funcs... functions) {
   co_return;
 }
 
-inline coros::Task<void> process_tasks(coros::Task<void>(*f)()) {
+inline coros::Task<void> process_tasks(std::allocator_arg_t, FrameAllocatorRef, coros::Task<void>(*f)()) {
   coros::Task<void> t = f();
   co_await t;
 
@@ -179,7 +182,7 @@ inline coros::Task<void> process_tasks(coros::Task<void>(*f)()) {
 }
 
 template<typename T, typename U, typename... Funcs>
-coros::Task<T> process_tasks(coros::Task<U>& starting_task, Funcs... functions) {
+coros::Task<T> process_tasks(std::allocator_arg_t, FrameAllocatorRef allocator, coros::Task<U>& starting_task, Funcs... functions) {
   // Execute the first task.
   co_await starting_task;
 
@@ -188,7 +191,7 @@ coros::Task<T> process_tasks(coros::Task<U>& starting_task, Funcs... functions)
   }   
   
   if constexpr (std::is_void_v<U>) {
-    auto next_task = coros::detail::process_tasks(functions...);
+    auto next_task = coros::detail::process_tasks(std::allocator_arg, allocator, functions...);
     co_await next_task;
     
     if (!next_task.has_value()) {
@@ -197,7 +200,7 @@ coros::Task<T> process_tasks(coros::Task<U>& starting_task, Funcs... functions)
 
     co_return;
   } else {
-    auto next_task = coros::detail::process_tasks<T>(*std::move(starting_task), functions...);
+    auto next_task = coros::detail::process_tasks<T>(std::allocator_arg, allocator, *std::move(starting_task), functions...);
     co_await next_task;
 
     if (!next_task.has_value()) {
@@ -214,7 +217,7 @@ coros::Task<T> process_tasks(coros::Task<U>& starting_task, Funcs... functions)
 
 // Base case
 template<typename T, typename U>
-coros::Task<T> process_tasks(coros::Task<U>& starting_task) {
+coros::Task<T> process_tasks(std::allocator_arg_t, FrameAllocatorRef, coros::Task<U>& starting_task) {
   
   // Execute the function
   co_await starting_task;
@@ -269,17 +272,34 @@ class ChainAwaitable {
 
   explicit ChainAwaitable(
     std::expected<StartingType, std::exception_ptr>&& ex, 
-    std::tuple<Funcs...>&& tuple) 
+    std::tuple<Funcs...>&& tuple,
+    std::pmr::memory_resource* resource) 
       : expected_(std::move(ex)),
-        functions_(std::move(tuple)) {}
+        functions_(std::move(tuple)),
+        resource_(resource) {}
 
   explicit ChainAwaitable(
     std::expected<StartingType, std::exception_ptr>&& ex, 
     std::tuple<Funcs...>&& tuple,
-    coros::Task<StartingType>&& starting_task)
+    coros::Task<StartingType>&& starting_task,
+    std::pmr::memory_resource* resource)
       : expected_(std::move(ex)),
         functions_(std::move(tuple)),
-        starting_task_(std::move(starting_task)) {}
+        starting_task_(std::move(starting_task)),
+        resource_(resource) {}
+
+  // Frames of the chain are allocated from the resource. Without it, a chain
+  // started with a task uses the allocator of that task.
+  void set_memory_resource(std::pmr::memory_resource* resource) noexcept { resource_ = resource; }
+
+  detail::FrameAllocatorRef frame_allocator() const noexcept {
+    if (resource_ != nullptr) return {nullptr, resource_};
+    if constexpr (TaskStart) {
+      return detail::frame_allocator_of(starting_task_.get_handle());
+    } else {
+      return {};
+    }
+  }
 
   // TODO : implement later
   // HACK : Getting some weird behavior with parsing the template,
@@ -299,8 +319,11 @@ class ChainAwaitable {
     constexpr bool await_ready() noexcept {return false;}
     
     // Here I should suspend, and run a task that runs individaul functions.
+    // Every stage of the chain inherits the stop token of the awaiting task.
+    template <typename Promise>
     std::coroutine_handle<> 
-    await_suspend(std::coroutine_handle<> currently_suspended) noexcept {
+    await_suspend(std::coroutine_handle<Promise> currently_suspended) noexcept {
+      loop_task_.get_handle().promise().inherit_stop_token(detail::stop_token_of(currently_suspended));
       loop_task_.get_handle().promise().set_continuation(currently_suspended);
       return loop_task_.get_handle();
     }
@@ -320,10 +343,12 @@ class ChainAwaitable {
           [this]() -> auto {
             if constexpr (!TaskStart) {
               return std::tuple_cat(
+                       std::make_tuple(std::allocator_arg, awaitable_->frame_allocator()),
                        std::make_tuple(std::move(awaitable_->expected_).value()), 
                        awaitable_->functions_);
             } else {
               return std::tuple_cat(
+                       std::make_tuple(std::allocator_arg, awaitable_->frame_allocator()),
                        std::tie(awaitable_->starting_task_), 
                        awaitable_->functions_);
             }
@@ -336,8 +361,11 @@ class ChainAwaitable {
     constexpr bool await_ready() noexcept {return false;}
     
     // Here I should suspend, and run a task that runs individaul functions.
+    // Every stage of the chain inherits the stop token of the awaiting task.
+    template <typename Promise>
     std::coroutine_handle<> 
-    await_suspend(std::coroutine_handle<> currently_suspended) noexcept {
+    await_suspend(std::coroutine_handle<Promise> currently_suspended) noexcept {
+      loop_task_.get_handle().promise().inherit_stop_token(detail::stop_token_of(currently_suspended));
       loop_task_.get_handle().promise().set_continuation(currently_suspended);
       return loop_task_.get_handle();
     }
@@ -356,10 +384,12 @@ class ChainAwaitable {
           [this]() -> auto {
             if constexpr (!TaskStart) {
               return std::tuple_cat(
+                       std::make_tuple(std::allocator_arg, awaitable_->frame_allocator()),
                        std::make_tuple(std::move(awaitable_->expected_).value()), 
                        awaitable_->functions_);
             } else {
               return std::tuple_cat(
+                       std::make_tuple(std::allocator_arg, awaitable_->frame_allocator()),
                        std::tie(awaitable_->starting_task_), 
                        awaitable_->functions_);
             }
@@ -387,11 +417,13 @@ class ChainAwaitable {
       return ChainAwaitable<StartingType, R, TaskStart, Funcs..., coros::Task<R>(*)(U)>{
         std::move(expected_),
         std::move(new_tuple),
-        std::move(starting_task_)};
+        std::move(starting_task_),
+        resource_};
     } else {
       return ChainAwaitable<StartingType, R, TaskStart, Funcs..., coros::Task<R>(*)(U)>{
         std::move(expected_),
-        std::move(new_tuple)};
+        std::move(new_tuple),
+        resource_};
     }
   }
 
@@ -405,11 +437,13 @@ class ChainAwaitable {
       return ChainAwaitable<StartingType, void, TaskStart, Funcs..., coros::Task<void>(*)()>{
         std::move(expected_),
         std::move(new_tuple),
-        std::move(starting_task_)};
+        std::move(starting_task_),
+        resource_};
     } else {
       return ChainAwaitable<StartingType, void, TaskStart, Funcs..., coros::Task<void>(*)()>{
         std::move(expected_),
-        std::move(new_tuple)};
+        std::move(new_tuple),
+        resource_};
     }
   }
    
@@ -417,6 +451,7 @@ class ChainAwaitable {
   std::expected<StartingType, std::exception_ptr> expected_;
   std::tuple<Funcs...> functions_;
   coros::Task<StartingType> starting_task_;
+  std::pmr::memory_resource* resource_ = nullptr;
 };
 
 
@@ -448,6 +483,14 @@ ChainAwaitable<std::remove_reference_t<T>, std::remove_reference_t<T>, false> ch
                         {std::forward<T&>(val)};
 }
 
+// Frames created by the chain are allocated from the memory resource.
+template<typename T>
+auto chain_tasks(std::allocator_arg_t, std::pmr::memory_resource* resource, T&& start) {
+  auto awaitable = chain_tasks(std::forward<T>(start));
+  awaitable.set_memory_resource(resource);
+  return awaitable;
+}
+
 } // namespace coros
 
 #endif  // COROS_INCLUDE_CHAIN_TASKS_H_
@@ -1,6 +1,7 @@
 #ifndef COROS_INCLUDE_DEQUE_H_
 #define COROS_INCLUDE_DEQUE_H_
 
+#include <algorithm>
 #include <atomic>
 #include <coroutine>
 #include <cstdint>
@@ -23,6 +24,8 @@ namespace detail {
 #endif
 
 inline constexpr size_t kDefaultBufferSize = 512;
+// Upper bound on the number of tasks taken by a single steal_batch().
+inline constexpr size_t kMaxStealBatch = 32;
 
 template <typename T>
 class CircularBuffer {
@@ -130,24 +133,36 @@ class Dequeue {
   };
 
   std::optional<std::coroutine_handle<>> steal() {
+    auto item = steal_item();
+    if (item.has_value()) return item->first;
+    return {};
+  };
+
+  // Steals up to half of the tasks in the deque, at most max_tasks. The first 
+  // stolen task is returned, the rest is pushed into the destination deque, which
+  // must be owned by the calling thread.
+  //
+  // Claiming several slots with one CAS on top_ is not safe, because popBottom
+  // takes elements without CAS while top < bottom. Therefore every task is claimed
+  // by its own CAS, but the thief does it in one go and does not have to search
+  // for victims again.
+  std::optional<std::coroutine_handle<>> steal_batch(Dequeue& destination,
+                                                     uint_fast64_t max_tasks = kMaxStealBatch) {
     std::uint_fast64_t top = top_.load(std::memory_order_acquire);
     std::atomic_thread_fence(std::memory_order_seq_cst);
     std::uint_fast64_t bottom = bottom_.load(std::memory_order_acquire);
-
-    if (top < bottom) {
-      std::pair<std::coroutine_handle<>, TaskLifeTime> return_handle = buffer_.load(std::memory_order_acquire)->get(top);
-
-      if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
-                                        std::memory_order_relaxed)) {
-        // failsed to steal the item
-        return {};
-      }
-      // return stolen item
-      return return_handle.first;
+    if (top >= bottom) return {};
+
+    uint_fast64_t count = std::min<uint_fast64_t>((bottom - top + 1) / 2, max_tasks);
+    auto first = steal_item();
+    if (!first.has_value()) return {};
+    for (uint_fast64_t i = 1; i < count; i++) {
+      auto item = steal_item();
+      if (!item.has_value()) break;
+      destination.pushBottom(std::move(item.value()));
     }
-    // return empty value queue is empty
-    return {};
-  };
+    return first->first;
+  }
 
   std::optional<std::coroutine_handle<>> popBottom() {
     uint_fast64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
@@ -188,6 +203,19 @@ class Dequeue {
     return return_handle.first;
   }
 
+  // Approximate number of tasks in the deque.
+  uint_fast64_t size() const noexcept {
+    uint_fast64_t bottom = bottom_.load(std::memory_order_acquire);
+    uint_fast64_t top = top_.load(std::memory_order_acquire);
+    return bottom > top ? bottom - top : 0;
+  }
+
+  // Approximate check used by idle workers before parking. The result
+  // can be stale by the time it is used, callers must tolerate that.
+  bool empty() const noexcept {
+    return bottom_.load(std::memory_order_acquire) <= top_.load(std::memory_order_acquire);
+  }
+
   // does not guarantee that the value is correct
   uint_fast64_t get_buffer_size() {
     return buffer_.load(std::memory_order_relaxed)->size();
@@ -201,6 +229,26 @@ class Dequeue {
   }
 
  private:
+  std::optional<std::pair<std::coroutine_handle<>, TaskLifeTime>> steal_item() {
+    std::uint_fast64_t top = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    std::uint_fast64_t bottom = bottom_.load(std::memory_order_acquire);
+
+    if (top < bottom) {
+      std::pair<std::coroutine_handle<>, TaskLifeTime> return_handle = buffer_.load(std::memory_order_acquire)->get(top);
+
+      if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                        std::memory_order_relaxed)) {
+        // failsed to steal the item
+        return {};
+      }
+      // return stolen item
+      return return_handle;
+    }
+    // return empty value queue is empty
+    return {};
+  }
+
   alignas(hardware_destructive_interference_size) std::atomic<uint_fast64_t> top_;
   alignas(hardware_destructive_interference_size) std::atomic<uint_fast64_t> bottom_;
 
@@ -2,7 +2,10 @@
 #define COROS_INCLUDE_ENQUEUE_TASK_H_
 
 #include <coroutine>
+#include <memory>
+#include <stop_token>
 
+#include "frame_allocator.h"
 #include "task.h"
 #include "thread_pool.h"
 
@@ -19,7 +22,7 @@ class DestroyTaskAwaiter {
 
   constexpr bool await_ready() const noexcept { return false; }
 
-  void await_suspend(std::coroutine_handle<NoWaitTaskPromise> handle) noexcept {
+  void await_suspend(std::coroutine_handle<> handle) noexcept {
     handle.destroy();
   }
 
@@ -73,6 +76,13 @@ class NoWaitTask {
 
 class NoWaitTaskPromise PROMISE_INSTANCE_COUNTER_ {
  public:
+  // Coroutine frames are allocated from the per-thread frame slabs. Wrappers
+  // and coroutines taking an allocator use the promises selected through
+  // std::coroutine_traits below.
+  static void* operator new(std::size_t size) { return detail::allocate_frame(size); }
+
+  static void operator delete(void* ptr) noexcept { detail::deallocate_frame(ptr); }
+
 
   auto get_return_object() {
     return NoWaitTask{std::coroutine_handle<NoWaitTaskPromise>::from_promise(*this)};
@@ -98,6 +108,45 @@ class NoWaitTaskPromise PROMISE_INSTANCE_COUNTER_ {
  private:
 };
 
+namespace detail {
+
+// Promise of create_NoWaitTask(Task<T>). Wrapper frames are allocated with
+// the allocator of the wrapped task.
+template <typename T>
+class TaskWrapperPromise : public NoWaitTaskPromise {
+ public:
+  static void* operator new(std::size_t size, const Task<T>& task) {
+    FrameAllocatorRef allocator = frame_allocator_of(task.get_handle());
+    if (allocator.frame == nullptr) return allocate_frame(size);
+    return allocate_frame_with(allocator, size);
+  }
+
+  static void operator delete(void* ptr) noexcept { deallocate_frame(ptr); }
+};
+
+} // namespace detail
+} // namespace coros
+
+template <typename T>
+struct std::coroutine_traits<coros::NoWaitTask, coros::Task<T>> {
+  using promise_type = coros::detail::TaskWrapperPromise<T>;
+};
+
+// Frames of coroutines with std::allocator_arg_t leading parameters.
+template <typename Alloc, typename... Args>
+struct std::coroutine_traits<coros::NoWaitTask, std::allocator_arg_t, Alloc, Args...> {
+  using promise_type = coros::detail::AllocatorPromise<coros::NoWaitTaskPromise, 1,
+                                                       std::allocator_arg_t, Alloc, Args...>;
+};
+
+template <typename Object, typename Alloc, typename... Args>
+struct std::coroutine_traits<coros::NoWaitTask, Object, std::allocator_arg_t, Alloc, Args...> {
+  using promise_type = coros::detail::AllocatorPromise<coros::NoWaitTaskPromise, 2,
+                                                       Object, std::allocator_arg_t, Alloc, Args...>;
+};
+
+namespace coros {
+
 // Accept task by value, because it will be destroyed once completed.
 template <typename T>
 inline NoWaitTask create_NoWaitTask(Task<T> t) {
@@ -119,18 +168,35 @@ inline void enqueue_tasks(ThreadPool& tp, Args... args) {
        detail::TaskLifeTime::THREAD_POOL_MANAGED}), ...);
 }
 
+// Called from inside of a thread pool, tasks are added to the current worker.
+// The last task goes into the worker's LIFO slot and runs next.
 template <typename... Args>
 requires (std::is_rvalue_reference_v<Args&&> && ...)
 inline void enqueue_tasks(Args&&... args) {
-  ((*thread_my_pool).add_task_from_outside(
+  ((*thread_my_pool).add_task(
       {create_NoWaitTask(std::move(args)).get_handle(), 
        detail::TaskLifeTime::THREAD_POOL_MANAGED}), ...);
 }
 
+// Enqueued tasks are detached from the calling task, so they do not inherit
+// its stop token. These overloads attach the given token to every task.
+template <typename... Args>
+requires (std::is_rvalue_reference_v<Args&&> && ...)
+inline void enqueue_tasks(std::stop_token stop_token, Args&&... args) {
+  (args.set_stop_token(stop_token), ...);
+  enqueue_tasks(std::move(args)...);
+}
+
+template <typename T>
+inline void enqueue_tasks(std::stop_token stop_token, std::vector<coros::Task<T>>&& vec) {
+  for (auto& task : vec) task.set_stop_token(stop_token);
+  enqueue_tasks(std::move(vec));
+}
+
 template <typename T>
 inline void enqueue_tasks(std::vector<coros::Task<T>>&& vec) {
   for(auto&& task : vec) {
-    (*thread_my_pool).add_task_from_outside({create_NoWaitTask(std::move(task)).get_handle(),
+    (*thread_my_pool).add_task({create_NoWaitTask(std::move(task)).get_handle(),
                               detail::TaskLifeTime::THREAD_POOL_MANAGED});
   }
 }
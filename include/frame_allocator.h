@@ -0,0 +1,452 @@
+#ifndef COROS_INCLUDE_FRAME_ALLOCATOR_H_
+#define COROS_INCLUDE_FRAME_ALLOCATOR_H_
+
+#include <array>
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#if defined(__SANITIZE_ADDRESS__)
+  #define COROS_FRAME_ALLOCATOR_ASAN_ 1
+#elif defined(__has_feature)
+  #if __has_feature(address_sanitizer)
+    #define COROS_FRAME_ALLOCATOR_ASAN_ 1
+  #endif
+#endif
+
+#ifdef COROS_FRAME_ALLOCATOR_ASAN_
+#include <sanitizer/asan_interface.h>
+#endif
+
+// Coroutine frames of tasks are allocated from per-thread slabs. If this
+// macro is defined, frames are allocated with the global operator new.
+// Frames of coroutines taking an allocator are not affected.
+// #define COROS_GLOBAL_FRAME_ALLOCATOR_
+
+namespace coros {
+namespace detail {
+
+// Frame sizes served from the slabs, including the block header. Larger
+// frames use the global operator new.
+inline constexpr std::array<size_t, 11> kFrameSizeClasses = {
+    64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048};
+inline constexpr size_t kFrameGranularity = 16;
+inline constexpr size_t kMaxSlabFrameSize = kFrameSizeClasses.back();
+// Memory carved into blocks of a single size class at once.
+inline constexpr size_t kFrameChunkSize = 64 * 1024;
+inline constexpr uint32_t kLargeFrame = UINT32_MAX;
+inline constexpr uint32_t kStackFrame = UINT32_MAX - 1;
+inline constexpr uint32_t kAllocatorFrame = UINT32_MAX - 2;
+// Frames of tasks are placed on a per-thread stack made of segments. Once
+// all segments are used, frames are allocated from the slabs.
+inline constexpr size_t kFrameStackSegmentSize = 32 * 1024;
+inline constexpr uint32_t kMaxFrameStackSegments = 8;
+
+// Maps (size + 15) / 16 to the index of the smallest fitting size class.
+inline constexpr auto kFrameSizeClassIndex = [] {
+  std::array<uint8_t, kMaxSlabFrameSize / kFrameGranularity + 1> index{};
+  size_t size_class = 0;
+  for (size_t i = 0; i < index.size(); i++) {
+    while (kFrameSizeClasses[size_class] < i * kFrameGranularity) size_class++;
+    index[i] = static_cast<uint8_t>(size_class);
+  }
+  return index;
+}();
+
+class FrameArena;
+
+// Type erased allocator a frame was allocated with. Placed in front of the
+// FrameHeader of frames of coroutines taking an allocator.
+struct AllocatorFrame {
+  void (*deallocate)(AllocatorFrame* frame) noexcept;
+  // Allocates another frame with a copy of the allocator.
+  void* (*allocate_like)(const AllocatorFrame* frame, size_t size);
+};
+
+// Placed in front of every frame. While the block is free, next links it
+// into a free list instead of storing the size class.
+struct alignas(kFrameGranularity) FrameHeader {
+  union {
+    FrameArena* owner;
+    AllocatorFrame* allocator;
+  };
+  union {
+    uint64_t size_class;
+    FrameHeader* next;
+  };
+};
+
+static_assert(sizeof(FrameHeader) == kFrameGranularity);
+
+// Placed in front of the FrameHeader of frames on the frame stack.
+struct alignas(kFrameGranularity) StackBlock {
+  StackBlock* prev;
+  uint32_t segment;
+  // Set when the frame is freed while it is not on the top of the stack or
+  // by another thread. Such blocks are popped once they reach the top.
+  std::atomic<uint32_t> freed;
+};
+
+static_assert(sizeof(StackBlock) == kFrameGranularity);
+
+// Slabs and frame stack of one thread. Only the owning thread allocates and
+// uses the local free lists. Other threads return blocks through the lock-free remote free
+// lists, which the owner takes over as a whole once its local list is empty.
+// Arenas are never released: when a thread exits, its arena is abandoned and
+// adopted by the next thread that needs one, so frames that outlive their
+// thread can still be freed.
+class FrameArena {
+ public:
+  void* allocate(size_t size) {
+    size_t size_class = kFrameSizeClassIndex[(size + sizeof(FrameHeader) + kFrameGranularity - 1) /
+                                             kFrameGranularity];
+    FrameHeader* block = free_[size_class];
+    if (block != nullptr) [[likely]] {
+      free_[size_class] = block->next;
+    } else {
+      block = remote_free_[size_class].head.exchange(nullptr, std::memory_order_acquire);
+      if (block != nullptr) {
+        free_[size_class] = block->next;
+      } else {
+        block = carve(size_class);
+      }
+    }
+#ifdef COROS_FRAME_ALLOCATOR_ASAN_
+    ASAN_UNPOISON_MEMORY_REGION(block + 1, kFrameSizeClasses[size_class] - sizeof(FrameHeader));
+#endif
+    block->owner = this;
+    block->size_class = size_class;
+    return block + 1;
+  }
+
+  // Called by the owning thread.
+  void deallocate_local(FrameHeader* block) noexcept {
+    size_t size_class = block->size_class;
+    poison(block);
+    block->next = free_[size_class];
+    free_[size_class] = block;
+  }
+
+  // Allocates a frame on top of the frame stack. Falls back to the slabs
+  // when the frame does not fit into a segment or all segments are used,
+  // which bounds the memory held by frames that are freed out of order.
+  void* allocate_stacked(size_t size) {
+    reclaim_stack();
+    size_t block_size = (size + kFrameGranularity - 1) / kFrameGranularity * kFrameGranularity +
+                        sizeof(StackBlock) + sizeof(FrameHeader);
+    if (stack_end_ - stack_next_ < static_cast<std::ptrdiff_t>(block_size)) {
+      uint32_t segment = stack_next_ == nullptr ? 0 : stack_segment_ + 1;
+      if (block_size > kFrameStackSegmentSize || segment >= kMaxFrameStackSegments) {
+        if (size + sizeof(FrameHeader) > kMaxSlabFrameSize) return allocate_large(size);
+        return allocate(size);
+      }
+      if (segment == stack_segments_.size()) {
+        stack_segments_.push_back(static_cast<std::byte*>(::operator new(kFrameStackSegmentSize)));
+      }
+      set_stack_position(segment, stack_segments_[segment]);
+    }
+    StackBlock* block =
+        ::new (static_cast<void*>(stack_next_)) StackBlock{stack_top_, stack_segment_, 0};
+    stack_top_ = block;
+    stack_next_ += block_size;
+
+    FrameHeader* header = reinterpret_cast<FrameHeader*>(block + 1);
+    header->owner = this;
+    header->size_class = kStackFrame;
+    return header + 1;
+  }
+
+  // Frames on the top of the owner's stack are popped right away, others
+  // are only marked as freed.
+  void deallocate_stacked(FrameHeader* header, bool local) noexcept {
+    StackBlock* block = reinterpret_cast<StackBlock*>(header) - 1;
+    if (local && block == stack_top_) {
+      pop_stack();
+      reclaim_stack();
+    } else {
+      block->freed.store(1, std::memory_order_release);
+    }
+  }
+
+  static void* allocate_large(size_t size) {
+    FrameHeader* block = static_cast<FrameHeader*>(::operator new(size + sizeof(FrameHeader)));
+    block->owner = nullptr;
+    block->size_class = kLargeFrame;
+    return block + 1;
+  }
+
+  // Called by any other thread.
+  void deallocate_remote(FrameHeader* block) noexcept {
+    RemoteList& list = remote_free_[block->size_class];
+    poison(block);
+    FrameHeader* head = list.head.load(std::memory_order_relaxed);
+    do {
+      block->next = head;
+    } while (!list.head.compare_exchange_weak(head, block, std::memory_order_release,
+                                              std::memory_order_relaxed));
+  }
+
+ private:
+  struct alignas(64) RemoteList {
+    std::atomic<FrameHeader*> head = nullptr;
+  };
+
+  static void poison([[maybe_unused]] FrameHeader* block) noexcept {
+#ifdef COROS_FRAME_ALLOCATOR_ASAN_
+    ASAN_POISON_MEMORY_REGION(block + 1,
+                              kFrameSizeClasses[block->size_class] - sizeof(FrameHeader));
+#endif
+  }
+
+  FrameHeader* carve(size_t size_class) {
+    size_t block_size = kFrameSizeClasses[size_class];
+    Bump& bump = bump_[size_class];
+    if (bump.end - bump.next < static_cast<std::ptrdiff_t>(block_size)) {
+      std::byte* chunk = static_cast<std::byte*>(::operator new(kFrameChunkSize));
+      chunks_.push_back(chunk);
+      bump.next = chunk;
+      bump.end = chunk + kFrameChunkSize;
+    }
+    FrameHeader* block = reinterpret_cast<FrameHeader*>(bump.next);
+    bump.next += block_size;
+    return block;
+  }
+
+  void set_stack_position(uint32_t segment, std::byte* next) noexcept {
+    stack_segment_ = segment;
+    stack_next_ = next;
+    stack_end_ = stack_segments_[segment] + kFrameStackSegmentSize;
+  }
+
+  void pop_stack() noexcept {
+    StackBlock* block = stack_top_;
+    stack_top_ = block->prev;
+    set_stack_position(block->segment, reinterpret_cast<std::byte*>(block));
+  }
+
+  void reclaim_stack() noexcept {
+    while (stack_top_ != nullptr && stack_top_->freed.load(std::memory_order_acquire)) {
+      pop_stack();
+    }
+  }
+
+  struct Bump {
+    std::byte* next = nullptr;
+    std::byte* end = nullptr;
+  };
+
+  std::array<FrameHeader*, kFrameSizeClasses.size()> free_{};
+  std::array<Bump, kFrameSizeClasses.size()> bump_{};
+  std::vector<std::byte*> chunks_;
+  std::vector<std::byte*> stack_segments_;
+  StackBlock* stack_top_ = nullptr;
+  std::byte* stack_next_ = nullptr;
+  std::byte* stack_end_ = nullptr;
+  uint32_t stack_segment_ = 0;
+  std::array<RemoteList, kFrameSizeClasses.size()> remote_free_{};
+};
+
+// Owns every arena and keeps the abandoned ones for reuse.
+class FrameArenaRegistry {
+ public:
+  FrameArena* acquire() {
+    std::lock_guard lock(mutex_);
+    if (!abandoned_.empty()) {
+      FrameArena* arena = abandoned_.back();
+      abandoned_.pop_back();
+      return arena;
+    }
+    arenas_.push_back(new FrameArena{});
+    return arenas_.back();
+  }
+
+  void abandon(FrameArena* arena) {
+    std::lock_guard lock(mutex_);
+    abandoned_.push_back(arena);
+  }
+
+  // Never destroyed, frames may be freed during static destruction.
+  static FrameArenaRegistry& instance() {
+    static FrameArenaRegistry* registry = new FrameArenaRegistry{};
+    return *registry;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::vector<FrameArena*> arenas_;
+  std::vector<FrameArena*> abandoned_;
+};
+
+// Arena of the current thread, acquired on first use.
+class ThreadFrameArena {
+ public:
+  // Frames freed by this thread afterwards go through the remote free list.
+  ~ThreadFrameArena() {
+    if (arena_ != nullptr) FrameArenaRegistry::instance().abandon(arena_);
+    arena_ = nullptr;
+  }
+
+  FrameArena* get() {
+    if (arena_ == nullptr) [[unlikely]] arena_ = FrameArenaRegistry::instance().acquire();
+    return arena_;
+  }
+
+  FrameArena* get_if_acquired() const noexcept { return arena_; }
+
+ private:
+  FrameArena* arena_ = nullptr;
+};
+
+inline thread_local ThreadFrameArena thread_frame_arena;
+
+// Used by operator new of promise types.
+inline void* allocate_frame(size_t size) {
+#ifdef COROS_GLOBAL_FRAME_ALLOCATOR_
+  return FrameArena::allocate_large(size);
+#else
+  if (size + sizeof(FrameHeader) > kMaxSlabFrameSize) [[unlikely]] {
+    return FrameArena::allocate_large(size);
+  }
+  return thread_frame_arena.get()->allocate(size);
+#endif
+}
+
+// Used by operator new of Task promises. Task frames are usually awaited in
+// place and destroyed before their parent continues, so they are placed on
+// the frame stack of the current thread. Frames destroyed out of order or on
+// another thread stay allocated until everything above them is freed.
+inline void* allocate_stacked_frame(size_t size) {
+#ifdef COROS_GLOBAL_FRAME_ALLOCATOR_
+  return FrameArena::allocate_large(size);
+#else
+  return thread_frame_arena.get()->allocate_stacked(size);
+#endif
+}
+
+// Frame memory is allocated in chunks, so the allocator returns memory
+// aligned for any frame.
+struct alignas(kFrameGranularity) FrameChunk {
+  std::byte bytes[kFrameGranularity];
+};
+
+template <typename ChunkAllocator>
+struct AllocatorFrameOf : AllocatorFrame {
+  ChunkAllocator allocator;
+  size_t chunks;
+};
+
+template <typename Alloc>
+void* allocate_frame_with(const Alloc& alloc, size_t size);
+
+// Reference to the allocator a chain of frames is allocated with. Either a
+// frame allocated with an allocator, whose allocator is copied, or a memory
+// resource. Without both, frames use the default allocation.
+struct FrameAllocatorRef {
+  const AllocatorFrame* frame = nullptr;
+  std::pmr::memory_resource* resource = nullptr;
+};
+
+// Allocates a frame with the allocator, the allocator is stored in front of
+// the frame, so it can be deallocated with deallocate_frame(). A
+// std::pmr::memory_resource* is used through std::pmr::polymorphic_allocator,
+// a null resource uses the default allocation.
+template <typename Alloc>
+void* allocate_frame_with(const Alloc& alloc, size_t size) {
+  if constexpr (std::is_same_v<Alloc, FrameAllocatorRef>) {
+    if (alloc.frame != nullptr) return alloc.frame->allocate_like(alloc.frame, size);
+    if (alloc.resource != nullptr) return allocate_frame_with(alloc.resource, size);
+    return allocate_stacked_frame(size);
+  } else if constexpr (std::is_convertible_v<Alloc, std::pmr::memory_resource*>) {
+    std::pmr::memory_resource* resource = alloc;
+    if (resource == nullptr) return allocate_stacked_frame(size);
+    return allocate_frame_with(std::pmr::polymorphic_allocator<FrameChunk>(resource), size);
+  } else {
+    using Traits = typename std::allocator_traits<Alloc>::template rebind_traits<FrameChunk>;
+    using ChunkAllocator = typename Traits::allocator_type;
+    using Record = AllocatorFrameOf<ChunkAllocator>;
+    constexpr size_t prefix = (sizeof(Record) + kFrameGranularity - 1) / kFrameGranularity *
+                              kFrameGranularity;
+
+    ChunkAllocator chunk_allocator(alloc);
+    size_t chunks = (prefix + sizeof(FrameHeader) + size + kFrameGranularity - 1) / kFrameGranularity;
+    FrameChunk* memory = Traits::allocate(chunk_allocator, chunks);
+    Record* record = ::new (static_cast<void*>(memory)) Record{
+        {[](AllocatorFrame* frame) noexcept {
+           Record* record = static_cast<Record*>(frame);
+           ChunkAllocator chunk_allocator(std::move(record->allocator));
+           size_t chunks = record->chunks;
+           record->~Record();
+           Traits::deallocate(chunk_allocator, reinterpret_cast<FrameChunk*>(record), chunks);
+         },
+         [](const AllocatorFrame* frame, size_t size) {
+           return allocate_frame_with(static_cast<const Record*>(frame)->allocator, size);
+         }},
+        std::move(chunk_allocator),
+        chunks};
+
+    FrameHeader* header = reinterpret_cast<FrameHeader*>(reinterpret_cast<std::byte*>(memory) + prefix);
+    header->allocator = record;
+    header->size_class = kAllocatorFrame;
+    return header + 1;
+  }
+}
+
+// Allocator of the frame of the given coroutine, if it was allocated with
+// one. Only valid for coroutines whose promise allocates through this file,
+// the coroutine handle address is the allocated frame.
+inline FrameAllocatorRef frame_allocator_of(std::coroutine_handle<> handle) noexcept {
+  if (!handle) return {};
+  FrameHeader* header = static_cast<FrameHeader*>(handle.address()) - 1;
+  if (header->size_class != kAllocatorFrame) return {};
+  return {header->allocator, nullptr};
+}
+
+// Used by operator delete of promise types.
+inline void deallocate_frame(void* ptr) noexcept {
+  FrameHeader* block = static_cast<FrameHeader*>(ptr) - 1;
+  if (block->size_class == kLargeFrame) [[unlikely]] {
+    ::operator delete(block);
+    return;
+  }
+  if (block->size_class == kAllocatorFrame) {
+    block->allocator->deallocate(block->allocator);
+    return;
+  }
+  FrameArena* owner = block->owner;
+  if (block->size_class == kStackFrame) {
+    owner->deallocate_stacked(block, owner == thread_frame_arena.get_if_acquired());
+    return;
+  }
+  if (owner == thread_frame_arena.get_if_acquired()) {
+    owner->deallocate_local(block);
+  } else {
+    owner->deallocate_remote(block);
+  }
+}
+
+// Promise of coroutines taking std::allocator_arg_t and an allocator, selected
+// through std::coroutine_traits with the coroutine's Params. The allocator is
+// the parameter at AllocatorIndex. Operator new is not a member template, so
+// it pairs with operator delete of the same class.
+template <typename Promise, size_t AllocatorIndex, typename... Params>
+class AllocatorPromise : public Promise {
+ public:
+  static void* operator new(std::size_t size, const std::remove_reference_t<Params>&... params) {
+    return allocate_frame_with(std::get<AllocatorIndex>(std::tie(params...)), size);
+  }
+
+  static void operator delete(void* ptr) noexcept { deallocate_frame(ptr); }
+};
+
+} // namespace detail
+} // namespace coros
+
+#endif  // COROS_INCLUDE_FRAME_ALLOCATOR_H_
@@ -0,0 +1,166 @@
+#ifndef COROS_INCLUDE_PERIODIC_H_
+#define COROS_INCLUDE_PERIODIC_H_
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <utility>
+
+#include "enqueue_tasks.h"
+#include "task_life_time.h"
+#include "thread_pool.h"
+#include "timer_wheel.h"
+
+namespace coros {
+namespace detail {
+
+struct PeriodicTick {
+  // Deadline of the next tick.
+  std::chrono::steady_clock::time_point next;
+  // Whether the expired tick runs.
+  bool run;
+};
+
+// Decides about a tick due at deadline, whose timer fired at now.
+inline PeriodicTick next_periodic_tick(std::chrono::steady_clock::time_point deadline,
+                                       std::chrono::steady_clock::time_point now,
+                                       std::chrono::steady_clock::duration period,
+                                       PeriodicPolicy policy) noexcept {
+  // Number of later ticks that are already due as well.
+  auto missed = now > deadline ? (now - deadline) / period : 0;
+  switch (policy) {
+    case PeriodicPolicy::CATCH_UP:
+      return {deadline + period, true};
+    case PeriodicPolicy::SKIP_MISSED:
+      return {deadline + (missed + 1) * period, missed == 0};
+    case PeriodicPolicy::DRIFT_FREE:
+      break;
+  }
+  return {deadline + (missed + 1) * period, true};
+}
+
+// Shared by the schedule handle and the timer. The timer callback spawns a
+// tick and arms the timer again, until the schedule is stopped.
+class PeriodicState {
+ public:
+  PeriodicState(ThreadPool& tp, std::chrono::steady_clock::duration period,
+                PeriodicPolicy policy, std::function<void()> spawn)
+      : tp_(tp), period_(period), policy_(policy), spawn_(std::move(spawn)) {
+    timer_.state = this;
+    timer_.on_expire = &PeriodicState::expire;
+  }
+
+  void start() {
+    deadline_ = std::chrono::steady_clock::now() + period_;
+    tp_.add_timer(timer_, deadline_);
+  }
+
+  // An expiring timer sees the flag once it armed itself again, so either
+  // the timer or this function removes it.
+  void stop() {
+    stopped_.store(true, std::memory_order_seq_cst);
+    if (tp_.cancel_timer(timer_)) release();
+  }
+
+  void release() noexcept {
+    if (references_.fetch_sub(1, std::memory_order_acq_rel) == 1) delete this;
+  }
+
+ private:
+  struct Timer : TimerNode {
+    PeriodicState* state;
+  };
+
+  // Runs on the timer thread. Once the timer is armed again, stop() may
+  // release the timer's and the handle's references, so the expiry holds
+  // its own until it returns.
+  static void expire(TimerNode* node) {
+    PeriodicState* state = static_cast<Timer*>(node)->state;
+    state->references_.fetch_add(1, std::memory_order_relaxed);
+    state->tick();
+    state->release();
+  }
+
+  void tick() {
+    if (stopped_.load(std::memory_order_seq_cst)) {
+      release();
+      return;
+    }
+    PeriodicTick tick = next_periodic_tick(deadline_, std::chrono::steady_clock::now(), period_,
+                                           policy_);
+    if (tick.run) spawn_();
+    deadline_ = tick.next;
+    tp_.add_timer(timer_, deadline_);
+    if (stopped_.load(std::memory_order_seq_cst) && tp_.cancel_timer(timer_)) release();
+  }
+
+  ThreadPool& tp_;
+  std::chrono::steady_clock::duration period_;
+  PeriodicPolicy policy_;
+  // Creates the task of a tick and adds it to the pool.
+  std::function<void()> spawn_;
+  Timer timer_;
+  // Only accessed by the timer thread after the start.
+  std::chrono::steady_clock::time_point deadline_;
+  std::atomic<bool> stopped_ = false;
+  // One reference for the handle and one for the timer, plus one while the
+  // timer expires.
+  std::atomic<size_t> references_ = 2;
+};
+
+} // namespace detail
+
+// Handle of a schedule created by ThreadPool::schedule_every. Stops the
+// schedule when destroyed, so it must not outlive the pool. Tasks of ticks
+// that already started are not affected.
+class PeriodicSchedule {
+ public:
+  explicit PeriodicSchedule(detail::PeriodicState* state) noexcept : state_(state) {}
+
+  PeriodicSchedule(PeriodicSchedule&& other) noexcept
+      : state_(std::exchange(other.state_, nullptr)) {}
+
+  PeriodicSchedule& operator=(PeriodicSchedule&& other) noexcept {
+    if (this != &other) {
+      stop();
+      state_ = std::exchange(other.state_, nullptr);
+    }
+    return *this;
+  }
+
+  PeriodicSchedule(const PeriodicSchedule&) = delete;
+  PeriodicSchedule& operator=(const PeriodicSchedule&) = delete;
+
+  ~PeriodicSchedule() { stop(); }
+
+  // No new ticks are created afterwards.
+  void stop() {
+    if (state_ == nullptr) return;
+    state_->stop();
+    state_->release();
+    state_ = nullptr;
+  }
+
+ private:
+  detail::PeriodicState* state_;
+};
+
+// Each tick creates a task with the factory on the timer thread and adds it to
+// the pool, tasks of ticks run independently of each other.
+template <typename Rep, typename Period, typename Factory>
+PeriodicSchedule ThreadPool::schedule_every(std::chrono::duration<Rep, Period> period,
+                                            Factory&& factory, PeriodicPolicy policy) {
+  auto spawn = [this, factory = std::forward<Factory>(factory)]() mutable {
+    add_task_from_outside({create_NoWaitTask(factory()).get_handle(),
+                           detail::TaskLifeTime::THREAD_POOL_MANAGED});
+  };
+  auto* state = new detail::PeriodicState(
+      *this, std::chrono::ceil<std::chrono::steady_clock::duration>(period), policy,
+      std::move(spawn));
+  state->start();
+  return PeriodicSchedule{state};
+}
+
+} // namespace coros
+
+#endif  // COROS_INCLUDE_PERIODIC_H_
@@ -0,0 +1,64 @@
+#ifndef COROS_INCLUDE_SLEEP_H_
+#define COROS_INCLUDE_SLEEP_H_
+
+#include <chrono>
+#include <coroutine>
+
+#include "thread_pool.h"
+#include "timer_wheel.h"
+
+namespace coros {
+
+// Suspends the awaiting coroutine until the deadline and resumes it on a
+// worker of the pool. The worker is free to run other tasks meanwhile.
+// Timers have a resolution of one millisecond and never fire early.
+class SleepAwaitable {
+ public:
+  SleepAwaitable(ThreadPool& pool, std::chrono::steady_clock::time_point deadline) noexcept
+      : pool_(pool), deadline_(deadline) {}
+
+  // The timer node is linked into the pool's wheel while suspended.
+  SleepAwaitable(const SleepAwaitable&) = delete;
+  SleepAwaitable& operator=(const SleepAwaitable&) = delete;
+
+  bool await_ready() const noexcept { return deadline_ <= std::chrono::steady_clock::now(); }
+
+  void await_suspend(std::coroutine_handle<> handle) {
+    node_.handle = handle;
+    pool_.add_timer(node_, deadline_);
+  }
+
+  void await_resume() const noexcept {}
+
+ private:
+  ThreadPool& pool_;
+  std::chrono::steady_clock::time_point deadline_;
+  detail::TimerNode node_;
+};
+
+// co_await coros::sleep_until(deadline), awaited from a worker of a pool.
+inline SleepAwaitable sleep_until(std::chrono::steady_clock::time_point deadline) noexcept {
+  return SleepAwaitable{*thread_my_pool, deadline};
+}
+
+inline SleepAwaitable sleep_until(ThreadPool& pool,
+                                  std::chrono::steady_clock::time_point deadline) noexcept {
+  return SleepAwaitable{pool, deadline};
+}
+
+// co_await coros::sleep_for(duration), awaited from a worker of a pool.
+template <typename Rep, typename Period>
+inline SleepAwaitable sleep_for(std::chrono::duration<Rep, Period> duration) noexcept {
+  return SleepAwaitable{*thread_my_pool, detail::deadline_after(duration)};
+}
+
+// Resumes the coroutine on the given pool, so it can be awaited from
+// outside of a pool as well.
+template <typename Rep, typename Period>
+inline SleepAwaitable sleep_for(ThreadPool& pool, std::chrono::duration<Rep, Period> duration) noexcept {
+  return SleepAwaitable{pool, detail::deadline_after(duration)};
+}
+
+} // namespace coros
+
+#endif  // COROS_INCLUDE_SLEEP_H_
@@ -1,7 +1,9 @@
 #ifndef COROS_INCLUDE_START_BARRIER_H_
 #define COROS_INCLUDE_START_BARRIER_H_
 
+#include <chrono>
 #include <condition_variable>
+#include <mutex>
 
 namespace coros {
 namespace detail {
@@ -21,13 +23,28 @@ class StartingBarrier {
     cv_.wait(lock, [this] { return flag_; });
   }
 
-  // Signals once the task is done.
-  void notify() {
-    {
-      std::lock_guard<std::mutex> lock(mtx_);
-      flag_ = true;
-      cv_.notify_all();
-    }
+  // Returns false if the deadline expired before the task was done.
+  bool wait_until(std::chrono::steady_clock::time_point deadline) {
+    std::unique_lock<std::mutex> lock(mtx_);
+    return cv_.wait_until(lock, deadline, [this] { return flag_; });
+  }
+
+  // Signals once the task is done. Returns true if nobody waits for the
+  // task anymore, so the finished task has to destroy itself.
+  bool notify() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    flag_ = true;
+    cv_.notify_all();
+    return abandoned_;
+  }
+
+  // The waiter gives up on an unfinished task. Returns false if the task
+  // is already done.
+  bool abandon() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (flag_) return false;
+    abandoned_ = true;
+    return true;
   }
 
   bool is_set () {
@@ -37,6 +54,7 @@ class StartingBarrier {
 
  private:
   bool flag_ = false;
+  bool abandoned_ = false;
   std::condition_variable cv_;
   std::mutex mtx_;
 };
@@ -1,7 +1,10 @@
 #ifndef COROS_INCLUDE_START_TASKS_H_
 #define COROS_INCLUDE_START_TASKS_H_
 
+#include <chrono>
 #include <coroutine>
+#include <stop_token>
+#include <type_traits>
 
 #include "start_barrier.h"
 #include "wait_tasks.h"
@@ -22,8 +25,9 @@ class NotifyBarrierAwaiter {
 
   constexpr bool await_ready() const noexcept { return false; }
 
-  void await_suspend([[maybe_unused]] std::coroutine_handle<StartTaskPromise> handle) noexcept {
-    barrier_.notify();
+  // An abandoned task destroys itself, see StartTask::detach().
+  void await_suspend(std::coroutine_handle<StartTaskPromise> handle) noexcept {
+    if (barrier_.notify()) handle.destroy();
   }
 
   void await_resume() noexcept {}
@@ -94,6 +98,14 @@ class StartTask {
 
   std::coroutine_handle<promise_type> get_handle() { return handle_; }
 
+  // Gives up waiting for an unfinished task, it destroys itself once done.
+  // Returns false if the task already finished.
+  bool detach() {
+    if (!handle_.promise().get_barrier().abandon()) return false;
+    handle_ = nullptr;
+    return true;
+  }
+
  private:
   std::coroutine_handle<promise_type> handle_ = nullptr;
 };
@@ -131,6 +143,27 @@ void start_sync(ThreadPool& scheduler, Args&&... args) {
   bt.get_handle().promise().get_barrier().wait();
 }
 
+// Like start_sync, but waits at most until the timeout expires. On expiry
+// the unfinished tasks get a stop request (see check_cancel()) and keep
+// running in the pool, so they are passed by value and destroyed once done.
+// The pool must outlive them.
+template <typename Rep, typename Period, typename... Args>
+requires (std::is_rvalue_reference_v<Args&&> && ...)
+WaitStatus start_sync_for(ThreadPool& scheduler, std::chrono::duration<Rep, Period> timeout,
+                          Args&&... args) {
+  auto deadline = detail::deadline_after(timeout);
+  std::stop_source stop_source;
+  (args.set_stop_token(stop_source.get_token()), ...);
+  // Resumed here, so the tasks are moved into the frame before we return.
+  StartTask bt = detail::start_task_body_async(scheduler, std::move(args)...);
+  bt.get_handle().resume();
+  if (bt.get_handle().promise().get_barrier().wait_until(deadline)) return WaitStatus::COMPLETED;
+  // Finished between the timeout and detaching.
+  if (!bt.detach()) return WaitStatus::COMPLETED;
+  stop_source.request_stop();
+  return WaitStatus::TIMEOUT;
+}
+
 // Return a barrier task, user must call wait.
 template <typename... Args>
 [[nodiscard]] StartTask start_async(ThreadPool& scheduler, Args&&... args) {
@@ -4,9 +4,13 @@
 #include <coroutine>
 #include <exception>
 #include <expected>
+#include <memory>
+#include <stop_token>
 #include <type_traits>
+#include <utility>
 
 #include "constructor_counter.hpp"
+#include "frame_allocator.h"
 
 namespace coros {
 
@@ -23,44 +27,141 @@ concept TaskRetunType = std::is_constructible_v<T,T>
 template <TaskRetunType ReturnValue>
 class Task;
 
+// Thrown into a task that starts or calls check_cancel() after a stop was
+// requested on its stop token. The task finishes with this error.
+class TaskCancelled : public std::exception {
+ public:
+  const char* what() const noexcept override { return "coros task cancelled"; }
+};
+
 namespace detail {
 
-// This awaiter resumes a coroutine by passing it a handle.
-// 
-// task<T> foo() {
-//   co_await BasicAwaiter{bar_handle};
-// }
-//
-// Pauses foo and resumes bar.
-class ResumeAwaiter {
+// Part of the promise shared by all Task types. Once the task finishes,
+// control is transferred either to the awaiting coroutine or, when the task
+// is awaited through wait_tasks, to the barrier, which resumes the awaiting
+// coroutine after the last task finishes. The barrier mode avoids wrapping
+// every awaited task into another coroutine.
+class TaskPromiseBase {
  public:
-  constexpr bool await_ready() noexcept { return false; }
+  // Task whose stop was requested before it started does not run its body.
+  // The pool only sees coroutine handles, so the check runs on the first
+  // resumption of the task.
+  class InitialAwaiter {
+   public:
+    constexpr bool await_ready() const noexcept { return false; }
 
-  std::coroutine_handle<> await_suspend  (
-      [[maybe_unused]] std::coroutine_handle<> currently_suspended) noexcept {
-    return to_resume_;
+    constexpr void await_suspend(std::coroutine_handle<>) const noexcept {}
+
+    void await_resume() const {
+      if (promise_->stop_token_.stop_requested()) [[unlikely]] throw TaskCancelled{};
+    }
+
+    TaskPromiseBase* promise_;
+  };
+
+  class FinalAwaiter {
+   public:
+    constexpr bool await_ready() noexcept { return false; }
+
+    // The frame can be destroyed by the awaiting coroutine as soon as the
+    // barrier is decremented, so the promise is not accessed afterwards.
+    std::coroutine_handle<> await_suspend(
+        [[maybe_unused]] std::coroutine_handle<> currently_suspended) noexcept {
+      void* barrier = promise_->barrier_;
+      if (barrier != nullptr) {
+        return promise_->decrement_and_resume_(barrier);
+      }
+      return promise_->continuation_;
+    }
+
+    void await_resume() noexcept {}
+
+    TaskPromiseBase* promise_;
+  };
+
+  // Lazily evaluated coroutine, suspend on initial_suspend.
+  InitialAwaiter initial_suspend() noexcept { return InitialAwaiter{this}; }
+
+  // If any task awaits this task, it is resumed. Otherwise default
+  // value of noop_coroutine is returned, returning control back to caller.
+  FinalAwaiter final_suspend() noexcept {
+    return FinalAwaiter{this};
   }
 
-  void await_resume() noexcept {}
+  void set_continuation(std::coroutine_handle<> cont) noexcept {
+    continuation_ = cont;
+    barrier_ = nullptr;
+  }
 
-  std::coroutine_handle<> to_resume_;
+  // BarrierType::decrement_and_resume() is called once the task finishes.
+  template <typename BarrierType>
+  void set_barrier(BarrierType* barrier) noexcept {
+    barrier_ = barrier;
+    decrement_and_resume_ = [](void* barrier) noexcept -> std::coroutine_handle<> {
+      return static_cast<BarrierType*>(barrier)->decrement_and_resume();
+    };
+  }
+
+  // Stop requests are only signals, a running task decides itself when to
+  // stop, see check_cancel().
+  void set_stop_token(std::stop_token token) noexcept { stop_token_ = std::move(token); }
+
+  const std::stop_token& stop_token() const noexcept { return stop_token_; }
+
+  // Tasks spawned by a task share its token, unless they have their own.
+  void inherit_stop_token(const std::stop_token* token) noexcept {
+    if (token != nullptr && !stop_token_.stop_possible()) stop_token_ = *token;
+  }
+
+ private:
+  // When we co_await task, we need to store a coroutine handle of a coroutine we want to resume
+  // when this tasks finishes. Allows for coroutine to coroutine transfer of control.
+  std::coroutine_handle<> continuation_ = std::noop_coroutine();
+  void* barrier_ = nullptr;
+  std::coroutine_handle<> (*decrement_and_resume_)(void* barrier) noexcept = nullptr;
+  // Empty unless the task or one of its ancestors got a stop token.
+  std::stop_token stop_token_;
 };
 
+// Stop callback requesting a stop on another source, used to pass a stop of
+// an awaiting task on to tasks that got their own source.
+struct ForwardStop {
+  void operator()() noexcept { source->request_stop(); }
+  std::stop_source* source;
+};
+
+// Stop token of a coroutine, nullptr if it has none. Only Task promises
+// carry a token.
+template <typename Promise>
+inline const std::stop_token* stop_token_of(std::coroutine_handle<Promise> handle) noexcept {
+  if constexpr (std::is_base_of_v<TaskPromiseBase, Promise>) {
+    const std::stop_token& token = handle.promise().stop_token();
+    if (token.stop_possible()) return &token;
+  }
+  return nullptr;
+}
+
 // Needs to be defined when running tests. Allows for checking the number
 // of task instances alive.
 #ifdef COROS_TEST_
-  #define INSTANCE_COUNTER_SIMPLE_PROMISE_ : private coros::test::InstanceCounter<SimplePromise<ReturnValue>>
+  #define INSTANCE_COUNTER_SIMPLE_PROMISE_ , private coros::test::InstanceCounter<SimplePromise<ReturnValue>>
 #else
   #define INSTANCE_COUNTER_SIMPLE_PROMISE_
 #endif
 
 // Promise object assosiacted with Task. 
 template <TaskRetunType ReturnValue>
-class SimplePromise  INSTANCE_COUNTER_SIMPLE_PROMISE_ {
+class SimplePromise : public TaskPromiseBase INSTANCE_COUNTER_SIMPLE_PROMISE_ {
  public:
 
   using ResultType = std::expected<ReturnValue, std::exception_ptr>;
 
+  // Task frames are allocated on the per-thread frame stack. Coroutines
+  // taking an allocator use AllocatorPromise, see std::coroutine_traits below.
+  static void* operator new(std::size_t size) { return allocate_stacked_frame(size); }
+
+  static void operator delete(void* ptr) noexcept { deallocate_frame(ptr); }
+
   template<typename T = SimplePromise<ReturnValue>>
   static std::enable_if_t<std::is_base_of_v<coros::test::InstanceCounter<SimplePromise<ReturnValue>>, T>, std::size_t>
   instance_count() {
@@ -78,16 +179,6 @@ class SimplePromise  INSTANCE_COUNTER_SIMPLE_PROMISE_ {
     return Task<ReturnValue>{std::coroutine_handle<SimplePromise>::from_promise(*this)};
   };
 
-  // Lazily evaluated coroutine, suspend on initial_suspend. 
-  std::suspend_always initial_suspend() noexcept { return {}; }
-  
-  // If any task awaits thsi task, it is resumed. Otherwise default
-  // value of noop_coroutine is passed to ResumeAwaiter, returning
-  // control back to caller.
-  ResumeAwaiter final_suspend() noexcept {
-    return ResumeAwaiter{continuation_};
-  }
-  
   template <typename T = ReturnValue, typename U>
   requires (std::is_nothrow_constructible_v<T, std::remove_reference_t<U>>
             || std::is_nothrow_constructible_v<T, U>)
@@ -172,30 +263,23 @@ class SimplePromise  INSTANCE_COUNTER_SIMPLE_PROMISE_ {
     return result_.has_value();
   }
 
-  void set_continuation(std::coroutine_handle<> cont) noexcept { continuation_ = cont; }
-
  private:
-  // When we co_await task, we need to store a coroutine handle of a coroutine we want to resume
-  // when this tasks finishes. Allows for coroutine to coroutine transfer of control.
-  // std::coroutine_handle<> continuation_ = nullptr;
-  std::coroutine_handle<> continuation_ = std::noop_coroutine();
   // Stores either value or a exception that was thrown during coroutine's execution.
   std::expected<ReturnValue, std::exception_ptr> result_{std::unexpect_t{}};
 };
 
 template <>
-class SimplePromise<void> {
+class SimplePromise<void> : public TaskPromiseBase {
  public:
 
   using ResultType = std::expected<void, std::exception_ptr>;
 
-  Task<void> get_return_object() noexcept; 
+  // Task frames are allocated on the per-thread frame stack.
+  static void* operator new(std::size_t size) { return allocate_stacked_frame(size); }
 
-  std::suspend_always initial_suspend() noexcept { return {}; }
-  
-  ResumeAwaiter final_suspend() noexcept {
-    return ResumeAwaiter{continuation_};
-  }
+  static void operator delete(void* ptr) noexcept { deallocate_frame(ptr); }
+
+  Task<void> get_return_object() noexcept; 
   
   // If the method returns void, and does not throw exception
   // we want the expected to has expected type void.
@@ -242,13 +326,7 @@ class SimplePromise<void> {
     return result_.has_value();
   }
 
-  void set_continuation(std::coroutine_handle<> cont) noexcept { continuation_ = cont; }
-
  private:
-  // When we co_await task, we need to store a coroutine handle of a coroutine we want to resume
-  // when this tasks finishes. Allows for coroutine to coroutine transfer of control.
-  // std::coroutine_handle<> continuation_ = nullptr;
-  std::coroutine_handle<> continuation_ = std::noop_coroutine();
   // Stores either value or a exception that was thrown during coroutine's execution.
   std::expected<void, std::exception_ptr> result_{std::unexpect_t{}};
 };
@@ -267,7 +345,10 @@ class ContinuationSetAwaiter {
 
   constexpr bool await_ready() noexcept { return false; }
 
-  std::coroutine_handle<> await_suspend(std::coroutine_handle<> currently_suspended) noexcept {
+  // The awaited task inherits the stop token of the awaiting task.
+  template <typename Promise>
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> currently_suspended) noexcept {
+    to_resume_.promise().inherit_stop_token(stop_token_of(currently_suspended));
     to_resume_.promise().set_continuation(currently_suspended);
     return to_resume_;
   }
@@ -400,10 +481,64 @@ class Task INSTANCE_COUNTER_ {
 
   std::coroutine_handle<promise_type> get_handle() const noexcept { return handle_; }
 
+  // Attaches a cancellation token to the task. Tasks spawned or awaited by
+  // this task inherit it, see check_cancel().
+  void set_stop_token(std::stop_token token) noexcept {
+    handle_.promise().set_stop_token(std::move(token));
+  }
+
+  // Gives up the ownership of the coroutine state, the caller is
+  // responsible for destroying it.
+  std::coroutine_handle<promise_type> release() noexcept {
+    return std::exchange(handle_, nullptr);
+  }
+
  private:
   std::coroutine_handle<promise_type> handle_ = nullptr;
 };
 
+// co_await coros::check_cancel() throws TaskCancelled if a stop was requested
+// on the token of the running task. The task is not suspended.
+class CheckCancelAwaitable {
+ public:
+  constexpr bool await_ready() const noexcept { return false; }
+
+  template <typename Promise>
+  bool await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+    cancelled_ = handle.promise().stop_token().stop_requested();
+    return false;
+  }
+
+  void await_resume() const {
+    if (cancelled_) throw TaskCancelled{};
+  }
+
+ private:
+  bool cancelled_ = false;
+};
+
+inline CheckCancelAwaitable check_cancel() noexcept { return {}; }
+
+// co_await coros::get_stop_token() returns the stop token of the running
+// task without suspending it.
+class GetStopTokenAwaitable {
+ public:
+  constexpr bool await_ready() const noexcept { return false; }
+
+  template <typename Promise>
+  bool await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+    token_ = handle.promise().stop_token();
+    return false;
+  }
+
+  std::stop_token await_resume() noexcept { return std::move(token_); }
+
+ private:
+  std::stop_token token_;
+};
+
+inline GetStopTokenAwaitable get_stop_token() noexcept { return {}; }
+
 // Placed here, because of forward declaration.
 inline Task<void> detail::SimplePromise<void>::get_return_object() noexcept {
   return Task<void>{std::coroutine_handle<detail::SimplePromise<void>>::from_promise(*this)};
@@ -411,4 +546,19 @@ inline Task<void> detail::SimplePromise<void>::get_return_object() noexcept {
 
 } // namespace coros
 
+// Coroutines taking std::allocator_arg_t and an allocator (or a
+// std::pmr::memory_resource*) as leading parameters allocate their frame with
+// it. The second specialization is used by member functions and lambdas.
+template <typename ReturnValue, typename Alloc, typename... Args>
+struct std::coroutine_traits<coros::Task<ReturnValue>, std::allocator_arg_t, Alloc, Args...> {
+  using promise_type = coros::detail::AllocatorPromise<coros::detail::SimplePromise<ReturnValue>, 1,
+                                                       std::allocator_arg_t, Alloc, Args...>;
+};
+
+template <typename ReturnValue, typename Object, typename Alloc, typename... Args>
+struct std::coroutine_traits<coros::Task<ReturnValue>, Object, std::allocator_arg_t, Alloc, Args...> {
+  using promise_type = coros::detail::AllocatorPromise<coros::detail::SimplePromise<ReturnValue>, 2,
+                                                       Object, std::allocator_arg_t, Alloc, Args...>;
+};
+
 #endif  // COROS_INCLUDE_TASK_H_
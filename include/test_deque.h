@@ -1,12 +1,14 @@
 #ifndef COROS_INCLUDE_TEST_DEQUE_H_
 #define COROS_INCLUDE_TEST_DEQUE_H_
 
+#include <algorithm>
 #include <mutex>
 #include <deque>
 #include <coroutine>
 #include <utility>
 #include <optional>
 
+#include "deque.h"
 #include "task_life_time.h"
 
 namespace coros {
@@ -40,6 +42,32 @@ class TestDeque {
     return std::nullopt;
   }
 
+  // Moves up to half of the tasks into the destination deque, the first one
+  // is returned.
+  std::optional<std::coroutine_handle<>> steal_batch(TestDeque& destination,
+                                                     size_t max_tasks = detail::kMaxStealBatch) {
+    std::optional<std::coroutine_handle<>> first;
+    std::deque<std::pair<std::coroutine_handle<>, detail::TaskLifeTime>> stolen;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (deque_.empty()) return std::nullopt;
+      size_t count = std::min((deque_.size() + 1) / 2, max_tasks);
+      first = deque_.front().first;
+      deque_.pop_front();
+      for (size_t i = 1; i < count; i++) {
+        stolen.push_back(deque_.front());
+        deque_.pop_front();
+      }
+    }
+    for (auto& task : stolen) destination.pushBottom(task);
+    return first;
+  }
+
+  size_t size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return deque_.size();
+  }
+
   bool empty() {
     std::lock_guard<std::mutex> lock(mutex_);
     return deque_.empty();
@@ -1,14 +1,28 @@
 #ifndef COROS_INCLUDE_THREAD_POOL_H_
 #define COROS_INCLUDE_THREAD_POOL_H_
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <coroutine>
+#include <cstdint>
+#include <latch>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <thread>
+#include <utility>
 #include <vector>
 #include <random>
 
 
+#include "blocking_threads.h"
 #include "deque.h"
 #include "concurrentqueue.h"
+#include "timer_wheel.h"
+#include "topology.h"
+#include "wait_barrier.h"
 
 #ifdef COROS_TEST_DEQUE_
 #include "test_deque.h"
@@ -18,6 +32,26 @@
 namespace coros {
 
 class ThreadPool;
+class PeriodicSchedule;
+
+// Awaiter that suspends the awaiting coroutine and resumes it on a worker
+// of the given pool. The coroutine handle itself is queued, so no coroutine
+// frame is created. Returned by ThreadPool::schedule() and resume_on().
+class ScheduleAwaitable {
+ public:
+  ScheduleAwaitable(ThreadPool& pool, bool skip_if_on_pool) noexcept
+      : pool_(pool), skip_if_on_pool_(skip_if_on_pool) {}
+
+  bool await_ready() const noexcept;
+
+  void await_suspend(std::coroutine_handle<> handle);
+
+  void await_resume() const noexcept {}
+
+ private:
+  ThreadPool& pool_;
+  bool skip_if_on_pool_;
+};
 
 // If this macro is defined the test Deque, using mutex is used
 #ifdef COROS_TEST_DEQUE_
@@ -26,6 +60,95 @@ class ThreadPool;
   #define DEQUE_ coros::detail::Dequeue
 #endif // DEBUG
 
+namespace detail {
+
+// Alignment separating data written by different threads. Fixed instead of
+// std::hardware_destructive_interference_size, whose value depends on the
+// tuning flags and warns with -Winterference-size.
+inline constexpr std::size_t kCacheLineSize = 64;
+
+// Task added from outside of the pool, together with the time it was added.
+struct InjectedTask {
+  std::coroutine_handle<> handle;
+  TaskLifeTime life_time;
+  std::chrono::steady_clock::time_point enqueue_time;
+};
+
+// State owned by a single worker thread. In NUMA mode it is allocated by the
+// worker itself, so the deque, its buffer and the generator are first-touched
+// on the worker's node.
+struct alignas(kCacheLineSize) Worker {
+  ~Worker() {
+    if (lifo_slot.first && lifo_slot.second == TaskLifeTime::THREAD_POOL_MANAGED) {
+      lifo_slot.first.destroy();
+    }
+  }
+
+  DEQUE_ queue;
+  // Task scheduled last by the running task, it runs next on this worker.
+  // Only the owning worker accesses it, so it cannot be stolen.
+  std::pair<std::coroutine_handle<>, TaskLifeTime> lifo_slot = {nullptr, TaskLifeTime::NOOP};
+  // Number of consecutive tasks taken from the LIFO slot.
+  uint_fast32_t lifo_streak = 0;
+  uint_fast32_t lifo_slot_cap = 0;
+  // Generator for picking a random victim inside a victim tier.
+  std::mt19937 gen;
+  // Indexes of other workers grouped by distance, closest tier first.
+  std::vector<std::vector<size_t>> victim_tiers;
+  // Number of leading tiers that are considered local. Remaining tiers
+  // are only searched after local_attempts failed local steal rounds.
+  size_t local_tiers = 0;
+  uint_fast32_t local_attempts = 0;
+  uint_fast32_t failed_local_rounds = 0;
+  int numa_node = 0;
+  // Injection queue shard the worker takes new tasks from first.
+  size_t injection_shard = 0;
+  // Counts local pops, every injection_poll_interval pops the injection
+  // queues are checked before the worker's own deque.
+  uint_fast32_t tick = 0;
+  uint_fast32_t injection_poll_interval = 0;
+  // Queueing delay of injected tasks taken by this worker. Written only by
+  // the owning worker.
+  std::atomic<uint_fast64_t> injected_tasks = 0;
+  std::atomic<uint_fast64_t> injected_latency_total_ns = 0;
+  std::atomic<uint_fast64_t> injected_latency_max_ns = 0;
+  // Number of successful steal operations and number of tasks they moved.
+  // Written only by the owning worker.
+  std::atomic<uint_fast64_t> steal_operations = 0;
+  std::atomic<uint_fast64_t> stolen_tasks = 0;
+  // Barriers of wait_tasks awaited on this worker.
+  JoinState joins;
+  // Execution budget of the task resumed last by the run loop, see
+  // consume_budget(). budget_deadline is set by the first consumed
+  // operation.
+  uint_fast32_t budget_used = 0;
+  uint_fast32_t budget_operations = 0;
+  std::chrono::steady_clock::duration budget_time{0};
+  std::chrono::steady_clock::time_point budget_deadline;
+};
+
+// The clock is read by the first consumed operation and then only every
+// kBudgetClockInterval operations.
+inline constexpr uint_fast32_t kBudgetClockInterval = 16;
+
+// Consumes one operation of the worker's budget. Returns true once the task
+// used up its operations or its time.
+inline bool consume_budget(Worker& worker) noexcept {
+  uint_fast32_t used = ++worker.budget_used;
+  if (worker.budget_operations != 0 && used >= worker.budget_operations) return true;
+  if (worker.budget_time.count() == 0) return false;
+  if (used == 1) {
+    worker.budget_deadline = std::chrono::steady_clock::now() + worker.budget_time;
+    return false;
+  }
+  if (used % kBudgetClockInterval != 0) return false;
+  return std::chrono::steady_clock::now() >= worker.budget_deadline;
+}
+
+} // namespace detail
+
+// Pointer to thread's own worker state.
+inline thread_local detail::Worker* thread_my_worker;
 // Pointer to thread's own task deque.
 inline thread_local DEQUE_*  thread_my_tasks;
 // inline thread_local Dequeue* thread_my_tasks;
@@ -36,12 +159,99 @@ inline thread_local std::mt19937* thread_gen;
 // Pointer to a thread pool to which the thread belongs to.
 inline thread_local ThreadPool*  thread_my_pool;
 
+// Idle strategy of a worker. A worker that fails to find a task keeps
+// looking for kIdleSpinRounds rounds, then yields its time slice for
+// kIdleYieldRounds rounds and finally parks until new work is announced.
+inline constexpr int kIdleSpinRounds = 64;
+inline constexpr int kIdleYieldRounds = 16;
+// Maximum number of injected tasks a worker moves into its deque at once.
+inline constexpr size_t kInjectionBatch = 16;
+
+// How worker threads are pinned to CPUs. Only CPUs the process is allowed
+// to run on (sched_getaffinity) are used, except for CPU_LIST.
+enum class Pinning {
+  NONE,          /*Workers are not pinned, the OS places them.*/
+  COMPACT,       /*Workers fill SMT siblings and cores of one socket first.*/
+  SCATTER,       /*Workers are spread across sockets and physical cores.*/
+  AFFINITY_MASK, /*Workers follow the order of the process affinity mask.*/
+  CPU_LIST,      /*Workers are pinned to the CPUs in ThreadPoolOptions::cpus.*/
+};
+
+// How tasks added from outside of the pool are spread over injection queues.
+enum class InjectionPlacement {
+  ROUND_ROBIN,  /*Shards are used in turn.*/
+  LEAST_LOADED, /*Shard with the fewest queued tasks is used.*/
+};
+
+// How wait_tasks hands its tasks to the pool.
+enum class SpawnPolicy {
+  HELP_FIRST, /*All tasks are queued, the worker picks one of them up.*/
+  WORK_FIRST, /*All but the last task are queued, the last one runs directly.*/
+};
+
+// What a periodic schedule does with ticks the timer missed, for example
+// because the pool was overloaded. Ticks are on the grid start + n * period.
+enum class PeriodicPolicy {
+  DRIFT_FREE,  /*One late tick runs at once, other missed ticks are dropped.*/
+  CATCH_UP,    /*Every missed tick runs, one after another.*/
+  SKIP_MISSED, /*Missed ticks are dropped, including the late one.*/
+};
+
+// Time injected tasks spent in the injection queues before a worker took them.
+struct InjectionLatency {
+  uint_fast64_t tasks = 0;
+  std::chrono::nanoseconds total{0};
+  std::chrono::nanoseconds max{0};
+};
+
+struct ThreadPoolOptions {
+  int thread_count = 1;
+  Pinning pinning = Pinning::NONE;
+  // Used with Pinning::CPU_LIST. Worker i is pinned to cpus[i % cpus.size()].
+  std::vector<int> cpus = {};
+  // Workers allocate their state on their own NUMA node and prefer victims
+  // from the same node. Unpinned workers are scattered across nodes.
+  bool numa_aware = false;
+  // Workers steal from their SMT sibling first, then from workers sharing
+  // the L3 cache and then from the rest of the machine. Unpinned workers
+  // are pinned compactly.
+  bool topology_aware = false;
+  // Number of failed steal rounds on the local node, before a worker
+  // tries to steal from other nodes.
+  int numa_local_attempts = 4;
+  // Tasks added from outside go into one injection queue per worker, or one
+  // per NUMA node for NUMA aware pools.
+  InjectionPlacement injection_placement = InjectionPlacement::ROUND_ROBIN;
+  // Every injection_poll_interval local pops, a worker checks the injection
+  // queues first, so injected tasks are not starved by deep local work.
+  // Zero disables the periodic check.
+  int injection_poll_interval = 61;
+  // Maximum number of consecutive tasks run from the per-worker LIFO slot.
+  // Once reached, the slot task is moved to the injection queue, so tasks
+  // scheduling each other cannot monopolize a worker. Zero disables the slot.
+  int lifo_slot_cap = 3;
+  // With WORK_FIRST, wait_tasks transfers control to its last task instead of
+  // queueing it, saving a push and pop of the local deque.
+  SpawnPolicy spawn_policy = SpawnPolicy::WORK_FIRST;
+  // Budget of a task resumed by a worker, co_await consume_budget() yields
+  // once the task used budget_operations operations or ran for budget_time.
+  // Zero disables the limit.
+  int budget_operations = 128;
+  std::chrono::microseconds budget_time{500};
+  // Maximum number of threads running run_blocking() calls. Started on
+  // demand, a thread exits after blocking_idle_timeout without work.
+  int blocking_threads = 64;
+  std::chrono::milliseconds blocking_idle_timeout{10000};
+};
+
 // Holds individual threads and their task queues.
 // TODO : delete constructors (move and copy)
 class ThreadPool {
  public:
   ThreadPool(int thread_count);
 
+  ThreadPool(const ThreadPoolOptions& options);
+
   void add_task(std::pair<std::coroutine_handle<>, detail::TaskLifeTime>&& task);
   
   void add_task_from_outside(std::pair<std::coroutine_handle<>, detail::TaskLifeTime>&& handle);
@@ -50,87 +260,745 @@ class ThreadPool {
 
   void stop_threads();
 
-  auto schedule_this_task();
+  // Resumes the coroutine of the node on this pool once the deadline passed.
+  // The node must stay alive until then, see sleep_for().
+  void add_timer(detail::TimerNode& node, std::chrono::steady_clock::time_point deadline);
+
+  // Returns false if the timer already expired.
+  bool cancel_timer(detail::TimerNode& node);
+
+  // Queues a suspended coroutine behind the work already queued on the
+  // calling worker, see yield(). Must be called from a worker of this pool.
+  void requeue(std::coroutine_handle<> handle);
+
+  // Runs the job on one of the blocking threads of this pool, see
+  // run_blocking().
+  void run_blocking_job(detail::BlockingJob& job);
+
+  // Number of blocking threads currently running.
+  size_t blocking_thread_count();
+
+  // Creates a task with factory() every period and runs it on this pool.
+  // All schedules of the pool share its timer wheel. The schedule runs until
+  // the returned handle is stopped or destroyed. Defined in periodic.h.
+  template <typename Rep, typename Period, typename Factory>
+  PeriodicSchedule schedule_every(std::chrono::duration<Rep, Period> period, Factory&& factory,
+                                  PeriodicPolicy policy = PeriodicPolicy::DRIFT_FREE);
+
+  // co_await pool.schedule() suspends the current coroutine and resumes it
+  // on a worker of this pool. Awaited from a worker of this pool, the
+  // coroutine is queued on that worker again.
+  ScheduleAwaitable schedule() noexcept { return ScheduleAwaitable{*this, false}; }
+
+  ScheduleAwaitable schedule_this_task() noexcept { return schedule(); }
+
+  // Number of workers currently parked, waiting for new work.
+  // The value is only a snapshot.
+  uint_fast32_t parked_workers() const noexcept {
+    return sleepers_.load(std::memory_order_relaxed);
+  }
+
+  // Number of workers currently trying to steal from other workers.
+  // The value is only a snapshot.
+  uint_fast32_t searching_workers() const noexcept {
+    return searching_.load(std::memory_order_relaxed);
+  }
+
+  // CPU the worker with the given index is pinned to, -1 if the worker
+  // is not pinned.
+  int worker_cpu(size_t index) const noexcept {
+    return index < worker_cpus_.size() ? worker_cpus_[index] : -1;
+  }
+
+  const std::vector<int>& worker_cpus() const noexcept { return worker_cpus_; }
+
+  // NUMA node of the worker with the given index. Always 0 when the pool
+  // is not NUMA or topology aware, -1 for unpinned workers otherwise.
+  int worker_numa_node(size_t index) const noexcept {
+    return index < worker_topology_.size() ? worker_topology_[index].node : 0;
+  }
+
+  // Total number of successful steal operations of all workers. A single
+  // operation can move several tasks, see stolen_tasks().
+  uint_fast64_t steal_operations() const noexcept {
+    uint_fast64_t count = 0;
+    for (auto& worker : worker_states_) {
+      count += worker->steal_operations.load(std::memory_order_relaxed);
+    }
+    return count;
+  }
+
+  // Total number of tasks moved by steal operations.
+  uint_fast64_t stolen_tasks() const noexcept {
+    uint_fast64_t count = 0;
+    for (auto& worker : worker_states_) {
+      count += worker->stolen_tasks.load(std::memory_order_relaxed);
+    }
+    return count;
+  }
+
+  // Queueing delay of injected tasks taken by the worker with the given index.
+  InjectionLatency injection_latency(size_t index) const noexcept {
+    InjectionLatency latency;
+    if (index >= worker_states_.size()) return latency;
+    const detail::Worker& worker = *worker_states_[index];
+    latency.tasks = worker.injected_tasks.load(std::memory_order_relaxed);
+    latency.total = std::chrono::nanoseconds(
+        worker.injected_latency_total_ns.load(std::memory_order_relaxed));
+    latency.max = std::chrono::nanoseconds(
+        worker.injected_latency_max_ns.load(std::memory_order_relaxed));
+    return latency;
+  }
+
+  // Upper bound on the number of workers stealing at the same time.
+  uint_fast32_t max_searching_workers() const noexcept { return max_searching_; }
+
+#ifdef COROS_TEST_
+  // Let tests take and release a searcher slot like a stealing worker.
+  bool test_try_start_searching() noexcept { return try_start_searching(); }
+
+  bool test_stop_searching() noexcept { return stop_searching(); }
+
+  // Number of times the last searcher that found work woke another worker.
+  uint_fast32_t searcher_wakeups() const noexcept {
+    return searcher_wakeups_.load(std::memory_order_relaxed);
+  }
+#endif
+
+  SpawnPolicy spawn_policy() const noexcept { return spawn_policy_; }
 
   ~ThreadPool();
 
  private:
   void run();
 
+  void park();
+
+  void notify_one_worker() noexcept;
+
+  bool has_work() noexcept;
+
+  bool try_start_searching() noexcept;
+
+  bool stop_searching() noexcept;
+
+  std::optional<std::coroutine_handle<>> take_injected(detail::Worker& worker, size_t max_tasks);
+
+  std::optional<std::coroutine_handle<>> flush_joins(detail::Worker& worker);
+
+  void record_injection_latency(detail::Worker& worker, const detail::InjectedTask* tasks,
+                                size_t count) noexcept;
+
+  std::optional<std::coroutine_handle<>> steal_from_tiers(detail::Worker& worker,
+                                                          size_t first_tier,
+                                                          size_t last_tier);
+
+  void init_worker(detail::Worker& worker, size_t index);
+
+  void add_tasks_from_outside(const std::vector<detail::InjectedTask>& tasks);
+
+  void run_timers();
+
+  void stop_timers();
+
   std::atomic<bool> threads_stop_executing_ = false;
+  // Eventcount used for parking idle workers. Parked workers wait on
+  // wake_epoch_, producers bump it whenever a task is added and at least
+  // one worker is parked.
+  alignas(detail::kCacheLineSize) std::atomic<uint_fast32_t> sleepers_ = 0;
+  alignas(detail::kCacheLineSize) std::atomic<uint32_t> wake_epoch_ = 0;
+  // Number of workers currently stealing. Limited to max_searching_ to
+  // reduce contention on the victims' deques.
+  alignas(detail::kCacheLineSize) std::atomic<uint_fast32_t> searching_ = 0;
+  uint_fast32_t max_searching_;
+#ifdef COROS_TEST_
+  std::atomic<uint_fast32_t> searcher_wakeups_ = 0;
+#endif
+
   std::vector<std::thread> workers_;
+  // Index-to-CPU mapping of workers, -1 for unpinned workers.
+  std::vector<int> worker_cpus_;
+  // Topology of the CPU each worker is pinned to. Only read when the pool
+  // is NUMA or topology aware, otherwise every worker is on node 0.
+  std::vector<detail::CpuInfo> worker_topology_;
+  bool numa_aware_;
+  bool topology_aware_;
+  uint_fast32_t numa_local_attempts_;
+
+  // State (deque, generator, victims) of each worker thread.
+  std::vector<std::unique_ptr<detail::Worker>> worker_states_;
+  // Workers and the constructor wait until every worker state is allocated.
+  std::latch workers_ready_;
+  // Used to get tasks to queue task from "outside" of ThreadPool. Sharded, so
+  // producers and consumers do not all contend on a single queue.
+  std::vector<std::unique_ptr<
+      moodycamel::ConcurrentQueue<detail::InjectedTask>>> injection_queues_;
+  InjectionPlacement injection_placement_;
+  uint_fast32_t injection_poll_interval_;
+  uint_fast32_t lifo_slot_cap_;
+  SpawnPolicy spawn_policy_;
+  uint_fast32_t budget_operations_;
+  std::chrono::steady_clock::duration budget_time_;
+  std::atomic<size_t> next_injection_shard_ = 0;
 
-  // Deques for each worker thread.
-  std::vector<DEQUE_> worker_queues_;
-  // Used to get tasks to queue task from "outside" of ThreadPool.
-  moodycamel::ConcurrentQueue<std::pair<std::coroutine_handle<>, detail::TaskLifeTime>> new_tasks_;
+  // Timers of sleeping coroutines. The timer thread is started with the
+  // first timer, it advances the wheel and injects expired coroutines in
+  // batches.
+  std::mutex timer_mutex_;
+  std::condition_variable timer_cv_;
+  detail::TimerWheel timer_wheel_;
+  std::thread timer_thread_;
+  bool timers_stop_ = false;
+  // Tick the timer thread sleeps until, UINT64_MAX if it waits for a timer.
+  uint64_t timer_wake_tick_ = UINT64_MAX;
+  // Expired coroutines and timers with callbacks, only used by the timer
+  // thread.
+  std::vector<detail::InjectedTask> expired_timers_;
+  std::vector<detail::TimerNode*> expired_callbacks_;
 
-  std::random_device rd_;
-  std::vector<std::mt19937> gens_;
-  std::uniform_int_distribution<> dists_;
+  // Threads for blocking calls, separate from the workers.
+  detail::BlockingThreads blocking_threads_;
 };
 
+namespace detail {
+
+// Computes which CPU each worker is pinned to.
+inline std::vector<int> compute_worker_cpus(const ThreadPoolOptions& options) {
+  std::vector<int> order;
+  switch (options.pinning) {
+    case Pinning::NONE:
+      break;
+    case Pinning::COMPACT:
+      order = compact_cpu_order(read_cpu_topology(allowed_cpus()));
+      break;
+    case Pinning::SCATTER:
+      order = scatter_cpu_order(read_cpu_topology(allowed_cpus()));
+      break;
+    case Pinning::AFFINITY_MASK:
+      order = allowed_cpus();
+      break;
+    case Pinning::CPU_LIST:
+      order = options.cpus;
+      break;
+  }
+
+  std::vector<int> worker_cpus(std::max(options.thread_count, 0), -1);
+#ifdef __linux__
+  if (!order.empty()) {
+    // CPUs outside of the affinity mask cannot be pinned to, their workers
+    // stay unpinned.
+    std::vector<int> allowed = allowed_cpus();
+    for (size_t i = 0; i < worker_cpus.size(); i++) {
+      int cpu = order[i % order.size()];
+      if (std::binary_search(allowed.begin(), allowed.end(), cpu)) worker_cpus[i] = cpu;
+    }
+  }
+#endif
+  return worker_cpus;
+}
+
+// Reads the topology of the CPU each worker is pinned to. Unpinned workers
+// of NUMA or topology aware pools have no package, core, L3 or node (-1) and
+// are remote to all other workers. Otherwise the topology is not used and
+// all workers are on node 0.
+inline std::vector<CpuInfo> compute_worker_topology(const std::vector<int>& worker_cpus,
+                                                    bool read_topology) {
+  if (!read_topology) return std::vector<CpuInfo>(worker_cpus.size(), CpuInfo{-1, 0, 0, 0, 0});
+  std::vector<CpuInfo> topology(worker_cpus.size());
+  std::vector<CpuInfo> infos = read_cpu_topology(worker_cpus);
+  for (size_t i = 0; i < infos.size(); i++) {
+    if (worker_cpus[i] >= 0) topology[i] = infos[i];
+  }
+  return topology;
+}
+
+// Sorted NUMA nodes the workers are placed on.
+inline std::vector<int> distinct_nodes(const std::vector<CpuInfo>& topology) {
+  std::vector<int> nodes;
+  for (auto& info : topology) nodes.push_back(info.node);
+  std::sort(nodes.begin(), nodes.end());
+  nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+  return nodes;
+}
+
+inline ThreadPoolOptions default_pinning(ThreadPoolOptions options) {
+  if (options.pinning != Pinning::NONE) return options;
+  if (options.numa_aware) {
+    options.pinning = Pinning::SCATTER;
+  } else if (options.topology_aware) {
+    options.pinning = Pinning::COMPACT;
+  }
+  return options;
+}
+
+} // namespace detail
+
 inline ThreadPool::ThreadPool(int thread_count)
-    : worker_queues_(std::vector<DEQUE_>(thread_count)), 
-      gens_(thread_count), 
-      dists_(0, thread_count - 1) {
+    : ThreadPool(ThreadPoolOptions{.thread_count = thread_count}) {}
+
+inline ThreadPool::ThreadPool(const ThreadPoolOptions& options)
+    : worker_cpus_(detail::compute_worker_cpus(detail::default_pinning(options))),
+      worker_topology_(detail::compute_worker_topology(
+          worker_cpus_, options.numa_aware || options.topology_aware)),
+      numa_aware_(options.numa_aware),
+      topology_aware_(options.topology_aware),
+      numa_local_attempts_(std::max(options.numa_local_attempts, 0)),
+      worker_states_(std::max(options.thread_count, 0)),
+      workers_ready_(std::max(options.thread_count, 0) + 1),
+      injection_placement_(options.injection_placement),
+      injection_poll_interval_(std::max(options.injection_poll_interval, 0)),
+      lifo_slot_cap_(std::max(options.lifo_slot_cap, 0)),
+      spawn_policy_(options.spawn_policy),
+      budget_operations_(std::max(options.budget_operations, 0)),
+      budget_time_(std::max(options.budget_time, std::chrono::microseconds(0))),
+      blocking_threads_(std::max(options.blocking_threads, 1), options.blocking_idle_timeout) {
+  int thread_count = options.thread_count;
+  // One shard per worker, or per node in NUMA mode. At least one shard
+  // is needed, so tasks can be added to a pool without workers.
+  size_t shard_count = std::max(thread_count, 1);
+  if (numa_aware_) {
+    shard_count = std::max<size_t>(detail::distinct_nodes(worker_topology_).size(), 1);
+  }
+  for (size_t i = 0; i < shard_count; i++) {
+    injection_queues_.push_back(
+        std::make_unique<moodycamel::ConcurrentQueue<detail::InjectedTask>>());
+  }
+  // At most half of the workers steal at once, but at least one.
+  max_searching_ = std::max(1, thread_count / 2);
+  // Without NUMA, the state is allocated here by the constructing thread.
+  if (!numa_aware_) {
+    for (int i = 0; i < thread_count; i++) {
+      worker_states_[i] = std::make_unique<detail::Worker>();
+      init_worker(*worker_states_[i], i);
+    }
+  }
   workers_.reserve(thread_count);
   for (int i = 0; i < thread_count; i++) {
-    DEQUE_* deque = &worker_queues_[i];
-    std::mt19937* gen = &gens_[i];
-    workers_.emplace_back([this, deque, gen]() {
-        thread_my_tasks = deque;
-        thread_gen = gen;
+    int cpu = worker_cpus_[i];
+    workers_.emplace_back([this, i, cpu]() {
+        // Pin first, so the NUMA-local allocation happens on the right node.
+        // Unpinned workers report -1, read after the constructor's latch.
+        if (cpu >= 0 && !detail::pin_current_thread(cpu)) worker_cpus_[i] = -1;
+        if (numa_aware_) {
+          worker_states_[i] = std::make_unique<detail::Worker>();
+          init_worker(*worker_states_[i], i);
+        }
+        workers_ready_.arrive_and_wait();
+        thread_my_worker = worker_states_[i].get();
+        thread_my_tasks = &thread_my_worker->queue;
+        thread_gen = &thread_my_worker->gen;
         thread_my_pool = this;
+        detail::thread_join_state = &thread_my_worker->joins;
         this->run();
     });
   }
+  workers_ready_.arrive_and_wait();
+}
+
+// Sets up victim tiers of a worker, closest victims first. Topology aware
+// pools use SMT sibling, shared L3, same node and remote tiers. NUMA aware
+// pools distinguish only the same node and remote tiers, the remote tier is
+// not local. Otherwise all other workers form a single tier.
+inline void ThreadPool::init_worker(detail::Worker& worker, size_t index) {
+  worker.gen.seed(static_cast<std::mt19937::result_type>(index));
+  worker.numa_node = worker_topology_[index].node;
+  worker.local_attempts = numa_local_attempts_;
+  worker.injection_poll_interval = injection_poll_interval_;
+  worker.lifo_slot_cap = lifo_slot_cap_;
+  worker.budget_operations = budget_operations_;
+  worker.budget_time = budget_time_;
+  if (numa_aware_) {
+    // Shards are ordered by node number.
+    std::vector<int> nodes = detail::distinct_nodes(worker_topology_);
+    worker.injection_shard =
+        std::lower_bound(nodes.begin(), nodes.end(), worker.numa_node) - nodes.begin();
+  } else {
+    worker.injection_shard = index;
+  }
+
+  constexpr size_t kTierCount = static_cast<size_t>(detail::CpuDistance::REMOTE) + 1;
+  std::vector<std::vector<size_t>> tiers(kTierCount);
+  for (size_t victim = 0; victim < worker_states_.size(); victim++) {
+    if (victim == index) continue;
+    detail::CpuDistance distance =
+        detail::cpu_distance(worker_topology_[index], worker_topology_[victim]);
+    if (!topology_aware_ && distance != detail::CpuDistance::REMOTE) {
+      distance = detail::CpuDistance::SAME_NODE;
+    }
+    if (!numa_aware_ && !topology_aware_) distance = detail::CpuDistance::SAME_NODE;
+    tiers[static_cast<size_t>(distance)].push_back(victim);
+  }
+
+  for (size_t distance = 0; distance < kTierCount; distance++) {
+    if (tiers[distance].empty()) continue;
+    // Without NUMA awareness all tiers are local and searched every round.
+    if (!numa_aware_ || distance != static_cast<size_t>(detail::CpuDistance::REMOTE)) {
+      worker.local_tiers++;
+    }
+    worker.victim_tiers.push_back(std::move(tiers[distance]));
+  }
 }
 
 
 // Individual threads use this method to add tasks into their own deque. 
+// The task goes into the worker's LIFO slot and runs next, skipping the deque.
+// A task already in the slot is moved into the deque.
 inline void ThreadPool::add_task(std::pair<std::coroutine_handle<>, detail::TaskLifeTime>&& handle) {
+  detail::Worker& me = *thread_my_worker;
+  if (me.lifo_slot_cap != 0) [[likely]] {
+    std::pair<std::coroutine_handle<>, detail::TaskLifeTime> previous =
+        std::exchange(me.lifo_slot, std::move(handle));
+    if (!previous.first) return;
+    handle = std::move(previous);
+  }
   thread_my_tasks->pushBottom(std::move(handle));
+  notify_one_worker();
 }
 
 // Used to add tasks from "outside"(not from within of the threadpool) not from individual threads. Tasks are pushed
 // into a different queue from which individual threads can take them as a new work.
 // New tasks cannot be pushed directly into the work-stealing dequeue.
 inline void ThreadPool::add_task_from_outside(std::pair<std::coroutine_handle<>, detail::TaskLifeTime>&& handle) {
-  new_tasks_.enqueue(std::move(handle));
+  size_t shard = 0;
+  if (injection_placement_ == InjectionPlacement::LEAST_LOADED) {
+    size_t min_size = SIZE_MAX;
+    for (size_t i = 0; i < injection_queues_.size(); i++) {
+      size_t size = injection_queues_[i]->size_approx();
+      if (size < min_size) {
+        min_size = size;
+        shard = i;
+      }
+    }
+  } else {
+    shard = next_injection_shard_.fetch_add(1, std::memory_order_relaxed) % injection_queues_.size();
+  }
+  injection_queues_[shard]->enqueue(
+      {handle.first, handle.second, std::chrono::steady_clock::now()});
+  notify_one_worker();
+}
+
+// Spreads tasks over the injection queues in chunks a worker takes at once.
+inline void ThreadPool::add_tasks_from_outside(const std::vector<detail::InjectedTask>& tasks) {
+  for (size_t i = 0; i < tasks.size(); i += kInjectionBatch) {
+    size_t count = std::min(kInjectionBatch, tasks.size() - i);
+    size_t shard = next_injection_shard_.fetch_add(1, std::memory_order_relaxed) % injection_queues_.size();
+    injection_queues_[shard]->enqueue_bulk(tasks.data() + i, count);
+    notify_one_worker();
+  }
+}
+
+inline void ThreadPool::add_timer(detail::TimerNode& node,
+                                  std::chrono::steady_clock::time_point deadline) {
+  bool wake = false;
+  {
+    std::lock_guard lock(timer_mutex_);
+    if (!timer_thread_.joinable() && !timers_stop_) {
+      timer_thread_ = std::thread([this]() { run_timers(); });
+    }
+    node.expires = timer_wheel_.tick_of(deadline);
+    timer_wheel_.insert(&node);
+    if (node.expires < timer_wake_tick_) {
+      timer_wake_tick_ = node.expires;
+      wake = true;
+    }
+  }
+  if (wake) timer_cv_.notify_one();
+}
+
+// The local deque is LIFO for its owner, so the coroutine goes to the
+// worker's injection shard. It runs once the local work is done, or earlier
+// through the periodic injection check, and other workers can take it.
+inline void ThreadPool::requeue(std::coroutine_handle<> handle) {
+  detail::Worker& me = *thread_my_worker;
+  injection_queues_[me.injection_shard]->enqueue(
+      {handle, detail::TaskLifeTime::SCOPE_MANAGED, std::chrono::steady_clock::now()});
+  notify_one_worker();
+}
+
+inline void ThreadPool::run_blocking_job(detail::BlockingJob& job) {
+  blocking_threads_.submit(&job);
+}
+
+inline size_t ThreadPool::blocking_thread_count() {
+  return blocking_threads_.thread_count();
+}
+
+inline bool ThreadPool::cancel_timer(detail::TimerNode& node) {
+  std::lock_guard lock(timer_mutex_);
+  return timer_wheel_.remove(&node);
+}
+
+// Main loop of the timer thread. The thread sleeps until the next tick the
+// wheel has to be advanced at. Expired coroutines are injected without
+// holding the lock, so adding timers is not blocked by the injection.
+inline void ThreadPool::run_timers() {
+  std::unique_lock lock(timer_mutex_);
+  while (!timers_stop_) {
+    auto now = std::chrono::steady_clock::now();
+    timer_wheel_.advance(timer_wheel_.elapsed_tick(now), [&](detail::TimerNode* node) {
+      if (node->on_expire != nullptr) {
+        expired_callbacks_.push_back(node);
+      } else {
+        expired_timers_.push_back({node->handle, detail::TaskLifeTime::SCOPE_MANAGED, now});
+      }
+    });
+    if (!expired_timers_.empty() || !expired_callbacks_.empty()) {
+      lock.unlock();
+      add_tasks_from_outside(expired_timers_);
+      expired_timers_.clear();
+      for (detail::TimerNode* node : expired_callbacks_) node->on_expire(node);
+      expired_callbacks_.clear();
+      lock.lock();
+      continue;
+    }
+    std::optional<uint64_t> next = timer_wheel_.next_tick();
+    timer_wake_tick_ = next.value_or(UINT64_MAX);
+    if (next.has_value()) {
+      timer_cv_.wait_until(lock, timer_wheel_.time_of(next.value()));
+    } else {
+      timer_cv_.wait(lock);
+    }
+  }
+}
+
+// Coroutines of pending timers are owned by their tasks, they are not resumed.
+inline void ThreadPool::stop_timers() {
+  {
+    std::lock_guard lock(timer_mutex_);
+    timers_stop_ = true;
+  }
+  timer_cv_.notify_all();
+  if (timer_thread_.joinable()) timer_thread_.join();
+}
+
+// Wakes up one parked worker, if there is any. The fence pairs with the
+// increment of sleepers_ in park(), either the producer sees the sleeping
+// worker or the worker sees the new task before it goes to sleep.
+inline void ThreadPool::notify_one_worker() noexcept {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (sleepers_.load(std::memory_order_relaxed) > 0) [[unlikely]] {
+    wake_epoch_.fetch_add(1, std::memory_order_release);
+    wake_epoch_.notify_one();
+  }
+}
+
+// Checks whether there is any work in the pool. Used by a worker before it
+// parks, the answer can be stale.
+inline bool ThreadPool::has_work() noexcept {
+  for (auto& worker : worker_states_) {
+    if (!worker->queue.empty()) return true;
+  }
+  for (auto& queue : injection_queues_) {
+    if (queue->size_approx() > 0) return true;
+  }
+  return false;
+}
+
+// Parks the calling worker until a producer bumps the wake epoch or the
+// pool is stopped. 
+inline void ThreadPool::park() {
+  uint32_t epoch = wake_epoch_.load(std::memory_order_acquire);
+  sleepers_.fetch_add(1, std::memory_order_seq_cst);
+  // Work could have been added before we announced ourselves as sleeping,
+  // in that case the producer did not see us and we must not sleep.
+  if (has_work() || threads_stop_executing_.load(std::memory_order_acquire)) {
+    sleepers_.fetch_sub(1, std::memory_order_relaxed);
+    return;
+  }
+  wake_epoch_.wait(epoch, std::memory_order_acquire);
+  sleepers_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+// A worker may only steal if the number of searching workers is below the
+// limit. Returns false if the worker should back off.
+inline bool ThreadPool::try_start_searching() noexcept {
+  uint_fast32_t searching = searching_.load(std::memory_order_relaxed);
+  do {
+    if (searching >= max_searching_) return false;
+  } while (!searching_.compare_exchange_weak(searching, searching + 1,
+                                             std::memory_order_acq_rel,
+                                             std::memory_order_relaxed));
+  return true;
+}
+
+// Returns true if the caller was the last searching worker.
+inline bool ThreadPool::stop_searching() noexcept {
+  return searching_.fetch_sub(1, std::memory_order_acq_rel) == 1;
+}
+
+// Tries to steal a task from the victims in tiers [first_tier, last_tier).
+// Each tier is scanned from a random position for even distribution.
+inline std::optional<std::coroutine_handle<>> ThreadPool::steal_from_tiers(
+    detail::Worker& worker, size_t first_tier, size_t last_tier) {
+  for (size_t tier_index = first_tier; tier_index < last_tier; tier_index++) {
+    const std::vector<size_t>& tier = worker.victim_tiers[tier_index];
+    if (tier.empty()) continue;
+    size_t random_index = worker.gen() % tier.size();
+    for (size_t i = 0; i < tier.size(); i++) {
+      size_t victim = tier[(random_index + i) % tier.size()];
+      // Takes up to half of the victim's tasks, the rest of them
+      // is pushed into our own deque.
+      auto task = worker_states_[victim]->queue.steal_batch(worker.queue);
+      if (task.has_value()) {
+        uint_fast64_t moved = 1 + worker.queue.size();
+        worker.steal_operations.store(
+            worker.steal_operations.load(std::memory_order_relaxed) + 1,
+            std::memory_order_relaxed);
+        worker.stolen_tasks.store(
+            worker.stolen_tasks.load(std::memory_order_relaxed) + moved,
+            std::memory_order_relaxed);
+        // Stolen tasks in our deque can be stolen by others.
+        if (moved > 1) notify_one_worker();
+        return task;
+      }
+    }
+  }
+  return {};
+}
+
+// Updates the worker's latency counters with the tasks taken from an
+// injection queue.
+inline void ThreadPool::record_injection_latency(detail::Worker& worker,
+                                                 const detail::InjectedTask* tasks,
+                                                 size_t count) noexcept {
+  auto now = std::chrono::steady_clock::now();
+  uint_fast64_t total = worker.injected_latency_total_ns.load(std::memory_order_relaxed);
+  uint_fast64_t max = worker.injected_latency_max_ns.load(std::memory_order_relaxed);
+  for (size_t i = 0; i < count; i++) {
+    auto latency =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(now - tasks[i].enqueue_time).count();
+    total += latency;
+    max = std::max<uint_fast64_t>(max, latency);
+  }
+  worker.injected_latency_total_ns.store(total, std::memory_order_relaxed);
+  worker.injected_latency_max_ns.store(max, std::memory_order_relaxed);
+  worker.injected_tasks.store(
+      worker.injected_tasks.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+}
+
+// Takes up to max_tasks tasks from the injection queues, own shard first. The first
+// task is returned and the rest is pushed into the worker's deque.
+inline std::optional<std::coroutine_handle<>> ThreadPool::take_injected(detail::Worker& worker,
+                                                                        size_t max_tasks) {
+  detail::InjectedTask tasks[kInjectionBatch];
+  max_tasks = std::min(max_tasks, kInjectionBatch);
+  for (size_t i = 0; i < injection_queues_.size(); i++) {
+    size_t shard = (worker.injection_shard + i) % injection_queues_.size();
+    size_t count = injection_queues_[shard]->try_dequeue_bulk(tasks, max_tasks);
+    if (count == 0) continue;
+
+    record_injection_latency(worker, tasks, count);
+    // Pushed in reverse, so the tasks are popped in the order they were added.
+    for (size_t j = count - 1; j > 0; j--) {
+      worker.queue.pushBottom({tasks[j].handle, tasks[j].life_time});
+    }
+    if (count > 1) notify_one_worker();
+    return tasks[0].handle;
+  }
+  return {};
+}
+
+// Flushes pending barriers of the worker. The first continuation that became
+// ready is returned, others are pushed into the worker's deque.
+inline std::optional<std::coroutine_handle<>> ThreadPool::flush_joins(detail::Worker& worker) {
+  std::optional<std::coroutine_handle<>> ready;
+  worker.joins.flush([&](std::coroutine_handle<> continuation) {
+    if (!ready.has_value()) {
+      ready = continuation;
+      return;
+    }
+    worker.queue.pushBottom({continuation, detail::TaskLifeTime::SCOPE_MANAGED});
+    notify_one_worker();
+  });
+  return ready;
 }
 
 // Main method run by each thread. Individual threads check for available work. 
 // New tasks are started through coroutine handle, by calling resume() on
 // the handle.
 inline std::coroutine_handle<> ThreadPool::get_task() {
+  detail::Worker& me = *thread_my_worker;
+  // Every injection_poll_interval ticks an injected task takes precedence over
+  // local ones, so they are not starved by deep recursive workloads. Only one
+  // task is taken, tasks moved into the deque would sit under the local work.
+  if (me.injection_poll_interval != 0 && ++me.tick >= me.injection_poll_interval) [[unlikely]] {
+    me.tick = 0;
+    auto injected = take_injected(me, 1);
+    if (injected.has_value()) return injected.value();
+  }
+
+  // A task of a barrier owned by this worker finished on another thread,
+  // local counts of the barriers are flushed so the last task can resume.
+  if (me.joins.must_flush()) [[unlikely]] {
+    auto ready = flush_joins(me);
+    if (ready.has_value()) return ready.value();
+  }
+
+  // Task in the LIFO slot runs first, unless the worker already ran too
+  // many of them in a row. In that case it is moved to the injection queue
+  // and other tasks get a chance to run.
+  if (me.lifo_slot.first) {
+    auto slot = std::exchange(me.lifo_slot, {nullptr, detail::TaskLifeTime::NOOP});
+    if (me.lifo_streak < me.lifo_slot_cap) [[likely]] {
+      me.lifo_streak++;
+      return slot.first;
+    }
+    me.lifo_streak = 0;
+    injection_queues_[me.injection_shard]->enqueue(
+        {slot.first, slot.second, std::chrono::steady_clock::now()});
+    notify_one_worker();
+  }
+
   // Worker tries to get task from its own queue. If there is a tasks
   // in its own deuque, the handle is returned. 
   auto task = thread_my_tasks->popBottom();
   if (task.has_value()) [[likely]] {
+    me.lifo_streak = 0;
     return task.value();
   }
 
+  // Without local work the remaining tasks of pending barriers run
+  // elsewhere, the barriers are flushed before the worker can park.
+  if (!me.joins.pending.empty()) {
+    auto ready = flush_joins(me);
+    if (ready.has_value()) return ready.value();
+  }
+
   // In case the thread does not have tasks in its own deque, it
-  // tries to steal from other threads.
-  // Random index is generate for even distribution.
-  int random_index = dists_(*thread_gen);
-  for (size_t i = 0; i < worker_queues_.size(); i++) {
-    int index = (random_index + i) % worker_queues_.size();
-    // Skip my own queue (can't steal from myself)
-    if (&worker_queues_[index] == thread_my_tasks) [[unlikely]] continue;
-    task = worker_queues_[index].steal();
+  // tries to steal from other threads. Only a limited number of workers
+  // steal at once, others back off and check the shared queue.
+  if (try_start_searching()) {
+    // Local tiers are searched first. Remote tiers only after several
+    // failed local rounds, so tasks stay on their node if possible.
+    task = steal_from_tiers(me, 0, me.local_tiers);
+    if (!task.has_value() && me.local_tiers < me.victim_tiers.size()) {
+      if (++me.failed_local_rounds >= me.local_attempts) {
+        task = steal_from_tiers(me, me.local_tiers, me.victim_tiers.size());
+      }
+    }
     if (task.has_value()) {
+      me.lifo_streak = 0;
+      me.failed_local_rounds = 0;
+      // The last searcher that found work wakes up another worker, there
+      // might be more work to steal.
+      if (stop_searching()) {
+#ifdef COROS_TEST_
+        searcher_wakeups_.fetch_add(1, std::memory_order_relaxed);
+#endif
+        notify_one_worker();
+      }
       return task.value();
     }
+    stop_searching();
   }
 
   // In case a thread does not have a task in its own deque nor steals 
-  // a task from another thread, we checked new_task qeueu, which is shared among
+  // a task from another thread, we check injection queues, which are shared among
   // all threads, for new work.
-  std::pair<std::coroutine_handle<>, detail::TaskLifeTime> new_task;
-  if (new_tasks_.try_dequeue(new_task)) {
-    return new_task.first; 
+  task = take_injected(me, kInjectionBatch);
+  if (task.has_value()) {
+    me.lifo_streak = 0;
+    return task.value();
   }
   
   // If there is no work, the std::noop_coroutine_handle is returned. Resuming this
@@ -138,14 +1006,33 @@ inline std::coroutine_handle<> ThreadPool::get_task() {
   return std::noop_coroutine();
 }
 
-// TODO: Implement thread yielding in case there is no work for an extended duration to 
-// not waste CPU.
-// Main loop run by each thread.
+// Main loop run by each thread. When there is no work, the worker spins, then
+// yields and finally parks, so an idle pool does not burn CPU.
 inline void ThreadPool::run() {
+  const std::coroutine_handle<> noop = std::noop_coroutine();
+  detail::Worker& me = *thread_my_worker;
+  int idle_rounds = 0;
   while (!threads_stop_executing_.load(std::memory_order::acquire)) [[likely]] {
     // Takes tasks and resumes it. If the qeuue is empty, 
     // it will return noop_coroutine.
-    this->get_task().resume();
+    std::coroutine_handle<> task = this->get_task();
+    if (task != noop) [[likely]] {
+      idle_rounds = 0;
+      // Every resumed task starts with a full budget.
+      me.budget_used = 0;
+      task.resume();
+      continue;
+    }
+
+    idle_rounds++;
+    if (idle_rounds <= kIdleSpinRounds) {
+      continue;
+    } else if (idle_rounds <= kIdleSpinRounds + kIdleYieldRounds) {
+      std::this_thread::yield();
+    } else {
+      park();
+      idle_rounds = 0;
+    }
   }
 }
 
@@ -154,22 +1041,51 @@ inline ThreadPool::~ThreadPool() {
 
   // Should be safe to use size_approx here, because 
   // all thread are stopped. 
-  size_t size = new_tasks_.size_approx();
-  std::vector<std::pair<std::coroutine_handle<>, detail::TaskLifeTime>> tasks(size);
-  new_tasks_.try_dequeue_bulk(tasks.data(), size);
+  for (auto& queue : injection_queues_) {
+    size_t size = queue->size_approx();
+    std::vector<detail::InjectedTask> tasks(size);
+    size = queue->try_dequeue_bulk(tasks.data(), size);
 
-  for (size_t i = 0; i < size; i++) {
-    if (tasks[i].second == detail::TaskLifeTime::THREAD_POOL_MANAGED) {
-      tasks[i].first.destroy();
+    for (size_t i = 0; i < size; i++) {
+      if (tasks[i].life_time == detail::TaskLifeTime::THREAD_POOL_MANAGED) {
+        tasks[i].handle.destroy();
+      }
     }
   }
 }
+inline bool ScheduleAwaitable::await_ready() const noexcept {
+  return skip_if_on_pool_ && thread_my_pool == &pool_;
+}
+
+// The coroutine may be resumed by another thread before this function
+// returns, so the awaiter must not be accessed after the handle is queued.
+// Tasks are owned by their Task objects, the pool does not destroy them.
+inline void ScheduleAwaitable::await_suspend(std::coroutine_handle<> handle) {
+  if (thread_my_pool == &pool_) {
+    pool_.add_task({handle, detail::TaskLifeTime::SCOPE_MANAGED});
+  } else {
+    pool_.add_task_from_outside({handle, detail::TaskLifeTime::SCOPE_MANAGED});
+  }
+}
+
+// co_await resume_on(pool) continues the current coroutine on a worker of
+// the pool. Does not suspend if the coroutine already runs on that pool.
+inline ScheduleAwaitable resume_on(ThreadPool& pool) noexcept {
+  return ScheduleAwaitable{pool, true};
+}
 
 // request stop for all threads
 // TODO : destruction of tasks
 inline void ThreadPool::stop_threads() {
+  stop_timers();
+  // Running and queued blocking calls finish and inject their coroutines,
+  // while the injection queues still exist. Later calls run on the caller.
+  blocking_threads_.stop();
   // TODO: Check for weaker synchronizatoin
   threads_stop_executing_.store(true, std::memory_order::release);
+  // Wake up all parked workers so they can observe the stop flag.
+  wake_epoch_.fetch_add(1, std::memory_order_release);
+  wake_epoch_.notify_all();
   for (auto& t : workers_) {
     t.join();
   }
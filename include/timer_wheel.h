@@ -0,0 +1,223 @@
+#ifndef COROS_INCLUDE_TIMER_WHEEL_H_
+#define COROS_INCLUDE_TIMER_WHEEL_H_
+
+#include <algorithm>
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+namespace coros {
+namespace detail {
+
+// Timer of a suspended coroutine. The node is embedded in the awaiter, which
+// lives in the coroutine frame, so timers need no allocation of their own.
+struct TimerNode {
+  // Links of the intrusive list of a wheel slot, nullptr if not queued.
+  TimerNode* prev = nullptr;
+  TimerNode* next = nullptr;
+  // Tick at which the timer expires.
+  uint64_t expires = 0;
+  std::coroutine_handle<> handle = nullptr;
+  // If set, called by the timer thread instead of resuming the handle. The
+  // node is not accessed afterwards, so the callback may free it.
+  void (*on_expire)(TimerNode*) = nullptr;
+
+  bool queued() const noexcept { return next != nullptr; }
+};
+
+// Hierarchical timer wheel with kLevels levels of kSlots slots. Level l
+// holds timers expiring in less than kSlots^(l+1) ticks, whose slots are
+// cascaded into lower levels once the wheel reaches them. Timers further away
+// wait in an overflow list. Inserting and removing a timer is O(1). The wheel
+// is not synchronized.
+class TimerWheel {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr std::chrono::milliseconds kTick{1};
+  static constexpr size_t kLevels = 4;
+  static constexpr size_t kSlotBits = 6;
+  static constexpr size_t kSlots = size_t{1} << kSlotBits;
+
+  explicit TimerWheel(Clock::time_point epoch = Clock::now()) : epoch_(epoch) {
+    for (auto& level : slots_) {
+      for (auto& slot : level) reset(slot);
+    }
+    reset(overflow_);
+    reset(expired_);
+  }
+
+  // Slots are sentinels of circular lists, they must not move.
+  TimerWheel(const TimerWheel&) = delete;
+  TimerWheel& operator=(const TimerWheel&) = delete;
+
+  // First tick at or after the given time, so a timer never fires early.
+  uint64_t tick_of(Clock::time_point time) const noexcept {
+    if (time <= epoch_) return 0;
+    auto ticks = (time - epoch_ + kTick - Clock::duration(1)) / kTick;
+    return static_cast<uint64_t>(ticks);
+  }
+
+  // Last tick at or before the given time.
+  uint64_t elapsed_tick(Clock::time_point time) const noexcept {
+    if (time <= epoch_) return 0;
+    return static_cast<uint64_t>((time - epoch_) / kTick);
+  }
+
+  Clock::time_point time_of(uint64_t tick) const noexcept { return epoch_ + tick * kTick; }
+
+  uint64_t current_tick() const noexcept { return current_tick_; }
+
+  size_t size() const noexcept { return size_; }
+
+  bool empty() const noexcept { return size_ == 0; }
+
+  // node->expires must be set. Timers that are already due expire on the
+  // next advance.
+  void insert(TimerNode* node) noexcept {
+    size_++;
+    if (node->expires <= current_tick_) {
+      link(expired_, node);
+    } else {
+      place(node);
+    }
+  }
+
+  // Returns false if the timer already expired or was never inserted.
+  bool remove(TimerNode* node) noexcept {
+    if (!node->queued()) return false;
+    unlink(node);
+    size_--;
+    return true;
+  }
+
+  // Moves the wheel to the given tick. Expired timers are unlinked and passed
+  // to on_expire in the order of their ticks.
+  template <typename F>
+  void advance(uint64_t to_tick, F&& on_expire) {
+    expire_slot(expired_, on_expire);
+    while (current_tick_ < to_tick) {
+      // Ticks without timers to expire or slots to cascade are skipped.
+      uint64_t tick = current_tick_ + 1;
+      if (is_empty(slots_[0][tick & (kSlots - 1)])) {
+        tick = std::min(next_tick().value_or(to_tick), to_tick);
+      }
+      current_tick_ = tick;
+      cascade(tick);
+      expire_slot(slots_[0][tick & (kSlots - 1)], on_expire);
+    }
+  }
+
+  // Tick at which the wheel has to be advanced next, either to expire a
+  // timer or to cascade a slot. Empty if there are no timers.
+  std::optional<uint64_t> next_tick() const noexcept {
+    if (size_ == 0) return std::nullopt;
+    if (!is_empty(expired_)) return current_tick_;
+    uint64_t next = UINT64_MAX;
+    for (size_t level = 0; level < kLevels; level++) {
+      size_t shift = level * kSlotBits;
+      uint64_t base = current_tick_ >> shift;
+      for (uint64_t j = 1; j <= kSlots; j++) {
+        if (!is_empty(slots_[level][(base + j) & (kSlots - 1)])) {
+          next = std::min(next, (base + j) << shift);
+          break;
+        }
+      }
+    }
+    if (!is_empty(overflow_)) {
+      size_t shift = (kLevels - 1) * kSlotBits;
+      next = std::min(next, ((current_tick_ >> shift) + 1) << shift);
+    }
+    return next;
+  }
+
+ private:
+  static void reset(TimerNode& sentinel) noexcept {
+    sentinel.prev = &sentinel;
+    sentinel.next = &sentinel;
+  }
+
+  static bool is_empty(const TimerNode& sentinel) noexcept { return sentinel.next == &sentinel; }
+
+  static void link(TimerNode& sentinel, TimerNode* node) noexcept {
+    node->prev = sentinel.prev;
+    node->next = &sentinel;
+    sentinel.prev->next = node;
+    sentinel.prev = node;
+  }
+
+  static void unlink(TimerNode* node) noexcept {
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = nullptr;
+    node->next = nullptr;
+  }
+
+  // Puts a timer expiring at or after the current tick into its slot.
+  void place(TimerNode* node) noexcept {
+    uint64_t delta = node->expires - current_tick_;
+    for (size_t level = 0; level < kLevels; level++) {
+      size_t shift = level * kSlotBits;
+      if (delta < (uint64_t{1} << (shift + kSlotBits))) {
+        link(slots_[level][(node->expires >> shift) & (kSlots - 1)], node);
+        return;
+      }
+    }
+    link(overflow_, node);
+  }
+
+  // Moves timers of the slots reached at this tick one level down. Higher
+  // levels go first, their timers can land in a lower slot cascaded next.
+  void cascade(uint64_t tick) noexcept {
+    for (size_t level = kLevels; level-- > 1;) {
+      size_t shift = level * kSlotBits;
+      if ((tick & ((uint64_t{1} << shift) - 1)) != 0) continue;
+      if (level == kLevels - 1) replace_all(overflow_);
+      replace_all(slots_[level][(tick >> shift) & (kSlots - 1)]);
+    }
+  }
+
+  void replace_all(TimerNode& sentinel) noexcept {
+    TimerNode* node = sentinel.next;
+    reset(sentinel);
+    while (node != &sentinel) {
+      TimerNode* next = node->next;
+      place(node);
+      node = next;
+    }
+  }
+
+  template <typename F>
+  void expire_slot(TimerNode& sentinel, F& on_expire) {
+    while (!is_empty(sentinel)) {
+      TimerNode* node = sentinel.next;
+      unlink(node);
+      size_--;
+      on_expire(node);
+    }
+  }
+
+  Clock::time_point epoch_;
+  uint64_t current_tick_ = 0;
+  size_t size_ = 0;
+  TimerNode slots_[kLevels][kSlots];
+  // Timers expiring after the last level.
+  TimerNode overflow_;
+  // Timers that were already due when inserted.
+  TimerNode expired_;
+};
+
+// Rounded up, so a timer never fires early.
+template <typename Rep, typename Period>
+inline std::chrono::steady_clock::time_point deadline_after(
+    std::chrono::duration<Rep, Period> duration) noexcept {
+  return std::chrono::steady_clock::now() +
+         std::chrono::ceil<std::chrono::steady_clock::duration>(duration);
+}
+
+} // namespace detail
+} // namespace coros
+
+#endif  // COROS_INCLUDE_TIMER_WHEEL_H_
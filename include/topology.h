@@ -0,0 +1,245 @@
+#ifndef COROS_INCLUDE_TOPOLOGY_H_
+#define COROS_INCLUDE_TOPOLOGY_H_
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace coros {
+namespace detail {
+
+// Description of a single logical CPU, as seen by the operating system.
+// Values that cannot be determined are left at -1.
+struct CpuInfo {
+  int cpu = -1;
+  // Socket the CPU belongs to.
+  int package = -1;
+  // Physical core within the socket, SMT siblings share the same core.
+  int core = -1;
+  // NUMA node the CPU belongs to.
+  int node = -1;
+  // Identifier of the last level cache domain, the lowest CPU number
+  // sharing the L3 cache with this CPU.
+  int l3 = -1;
+};
+
+// Reads a single integer from a sysfs file. Returns -1 if the file
+// cannot be read.
+inline int read_sysfs_int(const std::string& path) {
+  std::ifstream file(path);
+  int value = -1;
+  if (!(file >> value)) return -1;
+  return value;
+}
+
+// Parses a cpu list in the kernel format, for example "0-3,8,10-11".
+inline std::vector<int> parse_cpu_list(const std::string& list) {
+  std::vector<int> cpus;
+  std::stringstream ss(list);
+  std::string range;
+  while (std::getline(ss, range, ',')) {
+    if (range.empty() || range == "\n") continue;
+    size_t dash = range.find('-');
+    try {
+      if (dash == std::string::npos) {
+        cpus.push_back(std::stoi(range));
+      } else {
+        int first = std::stoi(range.substr(0, dash));
+        int last = std::stoi(range.substr(dash + 1));
+        for (int cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+      }
+    } catch (...) {
+      // Malformed entry, ignore it.
+    }
+  }
+  return cpus;
+}
+
+// Reads a cpu list from a sysfs file. Returns an empty vector if the file
+// cannot be read.
+inline std::vector<int> read_sysfs_cpu_list(const std::string& path) {
+  std::ifstream file(path);
+  std::string list;
+  if (!std::getline(file, list)) return {};
+  return parse_cpu_list(list);
+}
+
+// CPUs the process is allowed to run on. Falls back to all CPUs
+// reported by std::thread::hardware_concurrency.
+inline std::vector<int> allowed_cpus() {
+  std::vector<int> cpus;
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+      if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+    }
+  }
+#endif
+  if (cpus.empty()) {
+    int count = std::max(1u, std::thread::hardware_concurrency());
+    for (int cpu = 0; cpu < count; cpu++) cpus.push_back(cpu);
+  }
+  return cpus;
+}
+
+// Maps each CPU to its NUMA node by reading /sys/devices/system/node, so
+// libnuma is not needed. The returned vector is indexed by CPU number,
+// CPUs without a known node have -1.
+inline std::vector<int> read_cpu_nodes() {
+  std::vector<int> cpu_nodes;
+  std::vector<int> nodes = read_sysfs_cpu_list("/sys/devices/system/node/possible");
+  for (int node : nodes) {
+    std::vector<int> cpus = read_sysfs_cpu_list(
+        "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    for (int cpu : cpus) {
+      if (cpu >= static_cast<int>(cpu_nodes.size())) cpu_nodes.resize(cpu + 1, -1);
+      cpu_nodes[cpu] = node;
+    }
+  }
+  return cpu_nodes;
+}
+
+// Reads the L3 cache domain of a CPU from /sys/devices/system/cpu/cpuN/cache.
+// Returns -1 if there is no L3 cache information.
+inline int read_l3_domain(int cpu) {
+  std::string base = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/cache/index";
+  for (int index = 0; index < 16; index++) {
+    int level = read_sysfs_int(base + std::to_string(index) + "/level");
+    if (level < 0) break;
+    if (level != 3) continue;
+    std::vector<int> shared = read_sysfs_cpu_list(base + std::to_string(index) + "/shared_cpu_list");
+    if (shared.empty()) return cpu;
+    return *std::min_element(shared.begin(), shared.end());
+  }
+  return -1;
+}
+
+// Reads the topology of the given CPUs from /sys/devices/system/cpu.
+// Missing information is replaced so that every CPU is treated as its
+// own core on a single socket.
+inline std::vector<CpuInfo> read_cpu_topology(const std::vector<int>& cpus) {
+  std::vector<CpuInfo> infos;
+  infos.reserve(cpus.size());
+  std::vector<int> cpu_nodes = read_cpu_nodes();
+  for (int cpu : cpus) {
+    std::string base = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+    CpuInfo info;
+    info.cpu = cpu;
+    info.package = read_sysfs_int(base + "physical_package_id");
+    info.core = read_sysfs_int(base + "core_id");
+    if (cpu >= 0 && cpu < static_cast<int>(cpu_nodes.size())) info.node = cpu_nodes[cpu];
+    info.l3 = read_l3_domain(cpu);
+    if (info.package < 0) info.package = 0;
+    if (info.core < 0) info.core = cpu;
+    if (info.node < 0) info.node = 0;
+    // Without cache information, the whole socket is one L3 domain.
+    if (info.l3 < 0) info.l3 = -1 - info.package;
+    infos.push_back(info);
+  }
+  return infos;
+}
+
+// Distance between two CPUs, used to order steal victims. SMT siblings
+// are the closest, then CPUs sharing the L3 cache, then CPUs on the same
+// NUMA node and finally the rest of the machine.
+enum class CpuDistance {
+  SMT_SIBLING = 0,
+  SHARED_L3 = 1,
+  SAME_NODE = 2,
+  REMOTE = 3,
+};
+
+inline CpuDistance cpu_distance(const CpuInfo& a, const CpuInfo& b) {
+  // Unpinned workers may run anywhere, they are never close to another one.
+  if (a.cpu < 0 || b.cpu < 0) return CpuDistance::REMOTE;
+  if (a.package == b.package && a.core == b.core) return CpuDistance::SMT_SIBLING;
+  if (a.l3 == b.l3) return CpuDistance::SHARED_L3;
+  if (a.node == b.node) return CpuDistance::SAME_NODE;
+  return CpuDistance::REMOTE;
+}
+
+// Orders CPUs so that neighbouring entries are as close as possible, SMT
+// siblings first, then cores of the same socket.
+inline std::vector<int> compact_cpu_order(std::vector<CpuInfo> infos) {
+  std::sort(infos.begin(), infos.end(), [](const CpuInfo& a, const CpuInfo& b) {
+    if (a.package != b.package) return a.package < b.package;
+    if (a.core != b.core) return a.core < b.core;
+    return a.cpu < b.cpu;
+  });
+  std::vector<int> order;
+  order.reserve(infos.size());
+  for (auto& info : infos) order.push_back(info.cpu);
+  return order;
+}
+
+// Orders CPUs so that neighbouring entries are as far apart as possible.
+// Sockets are visited round-robin, within a socket a distinct physical core
+// is used before any SMT sibling.
+inline std::vector<int> scatter_cpu_order(std::vector<CpuInfo> infos) {
+  // Rank of each CPU among the SMT siblings of its core.
+  std::sort(infos.begin(), infos.end(), [](const CpuInfo& a, const CpuInfo& b) {
+    if (a.package != b.package) return a.package < b.package;
+    if (a.core != b.core) return a.core < b.core;
+    return a.cpu < b.cpu;
+  });
+  struct Ranked {
+    CpuInfo info;
+    int smt_rank;
+    int core_rank;
+  };
+  std::vector<Ranked> ranked;
+  ranked.reserve(infos.size());
+  int smt_rank = 0;
+  int core_rank = -1;
+  for (size_t i = 0; i < infos.size(); i++) {
+    bool new_package = i == 0 || infos[i].package != infos[i - 1].package;
+    bool new_core = new_package || infos[i].core != infos[i - 1].core;
+    if (new_package) core_rank = -1;
+    if (new_core) {
+      smt_rank = 0;
+      core_rank++;
+    } else {
+      smt_rank++;
+    }
+    ranked.push_back({infos[i], smt_rank, core_rank});
+  }
+  std::stable_sort(ranked.begin(), ranked.end(), [](const Ranked& a, const Ranked& b) {
+    if (a.smt_rank != b.smt_rank) return a.smt_rank < b.smt_rank;
+    if (a.core_rank != b.core_rank) return a.core_rank < b.core_rank;
+    return a.info.package < b.info.package;
+  });
+  std::vector<int> order;
+  order.reserve(ranked.size());
+  for (auto& r : ranked) order.push_back(r.info.cpu);
+  return order;
+}
+
+// Pins the calling thread to a single CPU. Returns false if pinning is not
+// supported or failed.
+inline bool pin_current_thread(int cpu) {
+#ifdef __linux__
+  if (cpu < 0 || cpu >= CPU_SETSIZE) return false;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+  (void)cpu;
+  return false;
+#endif
+}
+
+} // namespace detail
+} // namespace coros
+
+#endif  // COROS_INCLUDE_TOPOLOGY_H_
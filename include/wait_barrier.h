@@ -3,21 +3,85 @@
 
 #include <atomic>
 #include <coroutine>
-#include <memory>
+#include <utility>
+#include <vector>
 
 namespace coros {
 namespace detail {
 
+class WaitBarrier;
+
+// Join bookkeeping of a single pool worker. Children of barriers owned by
+// the worker, which also finish on it, are counted without atomics. The
+// counts are flushed into the shared counters only once a child of some
+// barrier finished on another thread, or when the worker runs out of work.
+struct JoinState {
+  // Barriers with unflushed local counts. Only the owning worker accesses it.
+  std::vector<WaitBarrier*> pending;
+  // Bumped by children of this worker's barriers finishing elsewhere.
+  std::atomic<uint_fast64_t> foreign_completions = 0;
+  uint_fast64_t seen_foreign_completions = 0;
+
+  bool must_flush() const noexcept {
+    return foreign_completions.load(std::memory_order_relaxed) != seen_foreign_completions;
+  }
+
+  // Flushes all pending barriers, calls resume with the continuation of
+  // each barrier that reached zero.
+  template<typename F>
+  void flush(F&& resume);
+
+  // Barriers do not finish in the order they were added, they are removed
+  // in constant time by moving the last barrier into their place.
+  void add(WaitBarrier* barrier);
+  void remove(WaitBarrier* barrier) noexcept;
+};
+
+// Join state of the current worker thread, nullptr outside of pools.
+inline thread_local JoinState* thread_join_state = nullptr;
+
 // Barrier is constructed with number of tasks that need to finish
 // and and a coroutine handle of the task that waits for them. Once
 // all tasks are finished the last task takes the handle and resumes
 // the waiting task(which is suspended).
+//
+// A barrier can be owned by the worker that scheduled the tasks. Tasks
+// finishing on the owner only bump a plain counter, the shared atomic
+// counter is touched by tasks that were stolen and by flushes of the
+// owner. If no task is stolen the waiting task is resumed without any
+// atomic read-modify-write.
 class WaitBarrier {
  public:
+  WaitBarrier(uint_fast64_t task_number, std::coroutine_handle<> continuation) noexcept
+      : remaining_tasks(task_number), continuation(continuation) {}
+
+  // Must be called before any task is scheduled.
+  void set_owner(JoinState* owner) noexcept {
+    owner_.store(owner, std::memory_order_relaxed);
+  }
 
   std::coroutine_handle<> decrement_and_resume() noexcept {
-    int remaining = remaining_tasks.fetch_sub(1, std::memory_order_acq_rel);
-    //int remaining = remaining_tasks.fetch_sub(1, std::memory_order::seq_cst);
+    JoinState* owner = owner_.load(std::memory_order_relaxed);
+    if (owner != nullptr && owner == thread_join_state) {
+      // Every task not counted by the shared counter finished here. Tasks
+      // finished elsewhere already saw a non-zero counter, nobody else
+      // resumes the continuation.
+      if (++local_done_ == remaining_tasks.load(std::memory_order_acquire)) {
+        if (queued_) owner->remove(this);
+        return continuation;
+      }
+      if (owner->must_flush()) [[unlikely]] {
+        if (queued_) owner->remove(this);
+        return flush();
+      }
+      if (!queued_) owner->add(this);
+      return std::noop_coroutine();
+    }
+
+    // The barrier can be destroyed once the counter is decremented, the
+    // owner is notified first.
+    if (owner != nullptr) owner->foreign_completions.fetch_add(1, std::memory_order_relaxed);
+    uint_fast64_t remaining = remaining_tasks.fetch_sub(1, std::memory_order_acq_rel);
     if (remaining == 1) {
       return continuation;
     } else {
@@ -25,8 +89,22 @@ class WaitBarrier {
     }
   }
 
+  // Moves local count into the shared counter. Called only by the owner,
+  // after the barrier was removed from the pending list. Some task already
+  // finished elsewhere, remaining tasks decrement the shared counter.
+  std::coroutine_handle<> flush() noexcept {
+    queued_ = false;
+    owner_.store(nullptr, std::memory_order_relaxed);
+    uint_fast64_t done = std::exchange(local_done_, 0);
+    if (done == 0) return std::noop_coroutine();
+    if (remaining_tasks.fetch_sub(done, std::memory_order_acq_rel) == done) {
+      return continuation;
+    }
+    return std::noop_coroutine();
+  }
+
   uint_fast64_t get_counter() {
-      return remaining_tasks;
+      return remaining_tasks - local_done_;
   }
 
   void set_continuation(std::coroutine_handle<> handle) {
@@ -40,67 +118,101 @@ class WaitBarrier {
   std::atomic<uint_fast64_t> remaining_tasks;
   // coroutine to resume, when the all tasks are done
   std::coroutine_handle<> continuation;
+
+ private:
+  // Other threads only read it to notify the owner.
+  std::atomic<JoinState*> owner_ = nullptr;
+  // Tasks finished on the owner and not yet flushed.
+  uint_fast64_t local_done_ = 0;
+  // Whether the barrier is in the owner's pending list and its position.
+  bool queued_ = false;
+  size_t pending_index_ = 0;
+
+  friend struct JoinState;
 };
 
+inline void JoinState::add(WaitBarrier* barrier) {
+  barrier->queued_ = true;
+  barrier->pending_index_ = pending.size();
+  pending.push_back(barrier);
+}
+
+inline void JoinState::remove(WaitBarrier* barrier) noexcept {
+  WaitBarrier* last = pending.back();
+  last->pending_index_ = barrier->pending_index_;
+  pending[barrier->pending_index_] = last;
+  pending.pop_back();
+  barrier->queued_ = false;
+}
+
+template<typename F>
+inline void JoinState::flush(F&& resume) {
+  seen_foreign_completions = foreign_completions.load(std::memory_order_acquire);
+  // Continuations can add barriers, the list is swapped out first.
+  std::vector<WaitBarrier*> barriers;
+  barriers.swap(pending);
+  for (WaitBarrier* barrier : barriers) {
+    std::coroutine_handle<> continuation = barrier->flush();
+    if (continuation != std::noop_coroutine()) resume(continuation);
+  }
+  barriers.clear();
+  if (pending.empty()) pending.swap(barriers);
+}
+
+// Barrier of wait_tasks_async. Tasks start before the parent awaits them,
+// so the continuation can be stored after some or all tasks finished.
+// A single state word packs the number of unfinished tasks, a bit set once
+// the continuation is stored and a bit set once the awaitable released the
+// barrier. The barrier lives on the heap and is deleted by whoever sees it
+// both finished and released, so tasks of an awaitable that was dropped
+// without being awaited still find it alive.
 class WaitBarrierAsync {
- public: WaitBarrierAsync(int task_number) noexcept 
-    : remaining_tasks(task_number), continuation(nullptr),
-      handle_ready_(false) {}
-  
-  // Each thread needs to make a copy of the shared_ptr to instance of this object.
-  // This prevents a scenario where compare_exchange_strong is called on deleted
-  // barrier. This can happen : 
-  //
-  //  1. Each task decrements the barrier. This allows the awaiter in other
-  //  thread to resume the coroutine. There is not need to wait. When all tasks
-  //  decremented the barrier, signalling they are done.
-  //  2. Last tasks tries to check wheter it should resume the coroutine or
-  //  not through compare_exchange_strong. However, the barrier is already
-  //  destroyed.
-  //
-  //  Task cannot know if itself is the last task until it decrements the barrier.
-  //  Therefore every task needs to make the copy of the pointer before decrement,
-  //  keeping the barrier alive.
+ public:
+  static constexpr uint_fast64_t kContinuationReady = 1;
+  static constexpr uint_fast64_t kReleased = 2;
+  static constexpr uint_fast64_t kTaskUnit = 4;
+
+  explicit WaitBarrierAsync(uint_fast64_t task_number) noexcept
+      : state_(task_number * kTaskUnit) {}
+
+  // The last task resumes the continuation if it is already stored,
+  // otherwise the awaiter does not suspend at all.
   std::coroutine_handle<> decrement_and_resume() noexcept {
-    std::shared_ptr<WaitBarrierAsync> barrier = std::atomic_load(barrier_p_);
-    int remaining = remaining_tasks.fetch_sub(1);
-    if (remaining == 1) {
-      // Last task.
-      bool expected = true;
-      if (handle_ready_.compare_exchange_strong(expected, false)) {
-        // This tasks resumes the coroutine and sets flag for the awaiter, so it 
-        // doesn't resume the coroutine. 
-        return continuation.load();
-      } else {
-        // Flag is not set. The awaiter will resume the coroutine.
-        return std::noop_coroutine();
-      }
-    } else {
+    uint_fast64_t previous = state_.fetch_sub(kTaskUnit, std::memory_order_acq_rel);
+    if (previous >= 2 * kTaskUnit) return std::noop_coroutine();
+    if (previous & kReleased) {
+      delete this;
       return std::noop_coroutine();
     }
+    if (previous & kContinuationReady) return continuation_;
+    return std::noop_coroutine();
   }
 
-  uint_fast64_t get_counter() {
-      return remaining_tasks.load();
+  // Stores the continuation. Returns false if all tasks already finished,
+  // the caller must not suspend in that case.
+  bool set_continuation(std::coroutine_handle<> handle) noexcept {
+    continuation_ = handle;
+    uint_fast64_t previous = state_.fetch_or(kContinuationReady, std::memory_order_acq_rel);
+    return previous >= kTaskUnit;
   }
 
-  void set_continuation(std::coroutine_handle<> handle) {
-      continuation = handle;
+  bool is_finished() const noexcept {
+    return state_.load(std::memory_order_acquire) < kTaskUnit;
   }
 
-  void set_barrier_pointer(std::shared_ptr<WaitBarrierAsync>* barrier_p) {
-    barrier_p_ = barrier_p;
+  uint_fast64_t get_counter() const noexcept {
+    return state_.load(std::memory_order_acquire) / kTaskUnit;
   }
 
-  std::coroutine_handle<> get_continuation () {
-      return continuation;
+  // Called by the owning awaitable once it no longer needs the barrier.
+  void release() noexcept {
+    uint_fast64_t previous = state_.fetch_or(kReleased, std::memory_order_acq_rel);
+    if (previous < kTaskUnit) delete this;
   }
 
-  std::atomic<uint_fast64_t> remaining_tasks;
-  // Coroutine to resume, when the all tasks are done. Initialized to nullptr
-  std::atomic<std::coroutine_handle<>> continuation;
-  std::shared_ptr<WaitBarrierAsync>* barrier_p_;
-  std::atomic<bool> handle_ready_; 
+ private:
+  std::atomic<uint_fast64_t> state_;
+  std::coroutine_handle<> continuation_ = nullptr;
 };
 
 } // namespace detail
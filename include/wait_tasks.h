@@ -2,9 +2,16 @@
 #define COROS_INCLUDE_WAIT_TASKS_H_
 
 #include <atomic>
+#include <chrono>
+#include <optional>
+#include <stop_token>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 #include "task_life_time.h"
+#include "timer_wheel.h"
 #include "wait_barrier.h"
 #include "task.h"
 #include "thread_pool.h"
@@ -15,55 +22,6 @@ namespace coros {
 namespace detail {
 
 
-// TODO: can do some concept for awaitable types
-template<typename BarrierType>
-class WaitTask;
-
-template<typename BarrierType>
-class WaitTaskPromise {
- public:
-  // TODO: look at exceptions
-  WaitTask<BarrierType> get_return_object();
-
-  std::suspend_always initial_suspend() noexcept { return {}; }
-
-  // when tasks finishes we need to decrease the counter
-  // on the barrier so we can resume the awaiting task
-  auto final_suspend() noexcept {
-    class DecreaseCounterAwaiter {
-     public:
-      // TODO : remove it so it can be may be trivially constructible ?
-      // DecreaseCounterAwaiter(WaitTaskPromise* p) noexcept : finished_task_promise(p) {}
-
-      constexpr bool await_ready() noexcept { return false; }
-
-      std::coroutine_handle<> await_suspend(
-          [[maybe_unused]] std::coroutine_handle<> currently_suspended) noexcept {
-        // TODO: make decrement_and_resume noexcept
-        return finished_task_promise->barrier_->decrement_and_resume();
-      }
-
-      void await_resume() noexcept {}
-
-      WaitTaskPromise* finished_task_promise;
-    };
-
-    return DecreaseCounterAwaiter{this};
-  }
-
-  void return_void() {}
-
-  // TODO: maybe change approach
-  void unhandled_exception() const { std::rethrow_exception(std::current_exception()); }
-
-  void set_barrier(BarrierType* bar) noexcept { barrier_ = bar; }
-
-  BarrierType& get_barrier() const noexcept { return *barrier_; }
-
- private:
-  BarrierType* barrier_;
-};
-
 // Needs to be defined when running tests. Allows for checking the number
 // of task instances alive.
 #ifdef COROS_TEST_
@@ -72,55 +30,123 @@ class WaitTaskPromise {
   #define INSTANCE_COUNTER_WAIT_TASK_
 #endif
 
-// Object representing a wait WaitTask, similar to Task object. This object
-// is used to manipulate WaitTask and the promise/coroutine state associated 
-// with it.
-// RAII object.
+// Task awaited through wait_tasks. The task decrements the barrier itself
+// once it finishes (see TaskPromiseBase), so the task handle is scheduled
+// directly, without a wrapping coroutine. If the task is passed as an rvalue,
+// its coroutine state is owned and destroyed by this object.
 template<typename BarrierType>
 class WaitTask INSTANCE_COUNTER_WAIT_TASK_ {
  public:
-  // need a public coroutine::promise_type for coroutine traits
-  // to deduce a promsie type
-  using promise_type = WaitTaskPromise<BarrierType>;
-
   template<typename T = WaitTask>
   static std::enable_if_t<std::is_base_of_v<coros::test::InstanceCounter<WaitTask>, T>, std::size_t>
   instance_count() {
     return coros::test::InstanceCounter<WaitTask>::instance_count();
   }
 
-  WaitTask(std::coroutine_handle<promise_type> handle) noexcept : task_handle_(handle){};
+  template<typename T>
+  WaitTask(Task<T>& task) noexcept
+      : task_handle_(task.get_handle()), promise_(&task.get_handle().promise()) {}
+
+  template<typename T>
+  WaitTask(Task<T>&& task) noexcept
+      : task_handle_(task.get_handle()), promise_(&task.get_handle().promise()), owned_(true) {
+    task.release();
+  }
 
   WaitTask(const WaitTask& other) = delete;
   WaitTask& operator=(const WaitTask& other) = delete;
 
-  WaitTask(WaitTask&& other) noexcept {
-    task_handle_ = other.task_handle_;
-    other.task_handle_ = nullptr;
-  }
+  WaitTask(WaitTask&& other) noexcept
+      : task_handle_(std::exchange(other.task_handle_, nullptr)),
+        promise_(std::exchange(other.promise_, nullptr)),
+        owned_(std::exchange(other.owned_, false)) {}
 
   WaitTask& operator=(WaitTask&& other) noexcept {
-    task_handle_ = other.task_handle_;
-    other.task_handle_ = nullptr;
+    if (this != &other) {
+      if (owned_ && task_handle_) task_handle_.destroy();
+      task_handle_ = std::exchange(other.task_handle_, nullptr);
+      promise_ = std::exchange(other.promise_, nullptr);
+      owned_ = std::exchange(other.owned_, false);
+    }
     return *this;
   }
-  
-  // Need to keep the if statement in case the task is moved,
-  // we do not want to destroy the state. RAII 
+
   ~WaitTask() {
-    if (task_handle_) {
+    if (owned_ && task_handle_) {
       task_handle_.destroy();
     }
   }
 
-  std::coroutine_handle<promise_type> get_handle() const noexcept { return task_handle_; }
+  std::coroutine_handle<> get_handle() const noexcept { return task_handle_; }
+
+  void set_barrier(BarrierType* barrier) const noexcept { promise_->set_barrier(barrier); }
+
+  void inherit_stop_token(const std::stop_token* token) const noexcept {
+    promise_->inherit_stop_token(token);
+  }
+
+  void set_stop_token(std::stop_token token) const noexcept {
+    promise_->set_stop_token(std::move(token));
+  }
 
-  void set_barrier(BarrierType* barrier) const noexcept { task_handle_.promise().set_barrier(barrier); }
+  // Result stored in the promise, T must be the value type of the task.
+  template<typename T>
+  typename SimplePromise<T>::ResultType&& take_result() noexcept {
+    return std::move(std::coroutine_handle<SimplePromise<T>>::from_address(
+        task_handle_.address()).promise()).expected();
+  }
 
  private:
-  std::coroutine_handle<promise_type> task_handle_;
+  std::coroutine_handle<> task_handle_;
+  TaskPromiseBase* promise_;
+  bool owned_ = false;
+};
+
+// Results returned by co_await wait_tasks(...). Tasks passed by reference
+// keep their results, so nothing is returned unless every task is passed
+// by value.
+struct NoResults {
+  using type = void;
+
+  template<typename Container>
+  static void collect(Container&) noexcept {}
 };
 
+// Results of tasks passed by value, moved out of their promises.
+template<typename... Ts>
+struct TupleResults {
+  using type = std::tuple<typename SimplePromise<Ts>::ResultType...>;
+
+  template<typename Container>
+  static type collect(Container& tasks) noexcept {
+    return collect(tasks, std::index_sequence_for<Ts...>{});
+  }
+
+  template<typename Container, size_t... Is>
+  static type collect(Container& tasks, std::index_sequence<Is...>) noexcept {
+    return type{tasks[Is].template take_result<Ts>()...};
+  }
+};
+
+template<typename T>
+struct VectorResults {
+  using type = std::vector<typename SimplePromise<T>::ResultType>;
+
+  template<typename Container>
+  static type collect(Container& tasks) {
+    type results;
+    results.reserve(tasks.size());
+    for (auto& task : tasks) results.push_back(task.template take_result<T>());
+    return results;
+  }
+};
+
+template<typename... Args>
+using WaitTasksResults = std::conditional_t<
+    (!std::is_lvalue_reference_v<Args> && ...),
+    TupleResults<typename std::remove_cvref_t<Args>::promise_type::ResultType::value_type...>,
+    NoResults>;
+
 } // namespace detail
 
 // An awaitable that is used that pauses current task, schedules individual tasks
@@ -137,38 +163,69 @@ class WaitTask INSTANCE_COUNTER_WAIT_TASK_ {
 //
 // Once all tasks are done the parent task foo, is resumed. It is resumed on the 
 // pool where t1 and t2 were executed.
+namespace detail {
+
+// Schedules tasks awaited by wait_tasks on the current worker. Returns the
+// handle the awaiting coroutine transfers control to. Tasks inherit the stop
+// token of the awaiting task.
 template <typename Container>
+inline std::coroutine_handle<> spawn_wait_tasks(ThreadPool& tp, Container& tasks,
+                                                WaitBarrier& barrier,
+                                                std::coroutine_handle<> continuation,
+                                                const std::stop_token* stop_token) noexcept {
+  // Nothing to wait for.
+  if (tasks.empty()) return continuation;
+
+  barrier.set_continuation(continuation);
+  // Tasks finishing on this worker are counted without atomics.
+  barrier.set_owner(thread_join_state);
+
+  size_t queued = tasks.size();
+  if (tp.spawn_policy() == SpawnPolicy::WORK_FIRST) queued--;
+  for (size_t i = 0; i < tasks.size(); i++) {
+    tasks[i].set_barrier(&barrier);
+    tasks[i].inherit_stop_token(stop_token);
+    if (i < queued) tp.add_task({tasks[i].get_handle(), TaskLifeTime::SCOPE_MANAGED});
+  }
+  if (queued == tasks.size()) return std::noop_coroutine();
+  return tasks.back().get_handle();
+}
+
+} // namespace detail
+
+template <typename Container, typename Results = detail::NoResults>
 class WaitTasksAwaitable {
  public:
 
   using TaskType = typename Container::value_type;
 
-  auto operator co_await() {
-    struct Awaiter {
-     public:
-
-      // This should be changed because task can be finished before we start executing.
-      // TODO : Changed only if we do async waiting
-      constexpr bool await_ready() const noexcept { return false; }
+  struct Awaiter {
+   public:
+
+    // This should be changed because task can be finished before we start executing.
+    // TODO : Changed only if we do async waiting
+    constexpr bool await_ready() const noexcept { return false; }
+
+    // Suspends current coroutine, sets barrier for all tasks, 
+    // sets continuation for the barrier(currently suspended coroutine) and 
+    // adds tasks to thread pool for execution. With the work-first policy
+    // the last task is not queued, the worker continues with it directly.
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> currently_suspended) noexcept {
+      return detail::spawn_wait_tasks(awaitable_->tp_, awaitable_->tasks_,
+                                      awaitable_->barrier_, currently_suspended,
+                                      detail::stop_token_of(currently_suspended));
+    }
 
-      // Suspends current coroutine, sets barrier for all tasks, 
-      // sets continuation for the barrier(currently suspended coroutine) and 
-      // adds tasks to thread pool for execution.
-      void await_suspend(std::coroutine_handle<> currently_suspended) noexcept {
-        awaitable_->barrier_.set_continuation(currently_suspended);
+    // Moves results of tasks passed by value out of their promises.
+    typename Results::type await_resume() {
+      return Results::collect(awaitable_->tasks_);
+    }
 
-        for (auto& task : awaitable_->tasks_) {
-          task.set_barrier(&(awaitable_->barrier_));
-          awaitable_->tp_.add_task({task.get_handle(), detail::TaskLifeTime::SCOPE_MANAGED});
-        }
-      }
+    WaitTasksAwaitable* awaitable_;
+  };
 
-      void await_resume() noexcept {}
-
-      WaitTasksAwaitable* awaitable_;
-    };
-    return Awaiter{this};
-  }
+  Awaiter operator co_await() { return Awaiter{this}; }
 
   Container& get_tasks() noexcept { return tasks_; }              
 
@@ -181,32 +238,30 @@ template <typename ThreadPool>
 class WaitTasksAwaitableVector {
  public:
 
-  auto operator co_await() {
-    struct Awaiter {
-     public:
+  struct Awaiter {
+   public:
+
+    // This should be changed because task can be finished before we start executing.
+    // TODO : Changed only if we do async waiting
+    constexpr bool await_ready() const noexcept { return false; }
+
+    // Suspends current coroutine, sets barrier for all tasks, 
+    // sets continuation for the barrier(currently suspended coroutine) and 
+    // adds tasks to thread pool for execution. With the work-first policy
+    // the last task is not queued, the worker continues with it directly.
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> currently_suspended) noexcept {
+      return detail::spawn_wait_tasks(awaitable_->tp_, awaitable_->tasks_,
+                                      awaitable_->barrier_, currently_suspended,
+                                      detail::stop_token_of(currently_suspended));
+    }
 
-      // This should be changed because task can be finished before we start executing.
-      // TODO : Changed only if we do async waiting
-      constexpr bool await_ready() const noexcept { return false; }
+    void await_resume() noexcept {}
 
-      // Suspends current coroutine, sets barrier for all tasks, 
-      // sets continuation for the barrier(currently suspended coroutine) and 
-      // adds tasks to thread pool for execution.
-      void await_suspend(std::coroutine_handle<> currently_suspended) noexcept {
-        awaitable_->barrier_.set_continuation(currently_suspended);
+    WaitTasksAwaitableVector* awaitable_;
+  };
 
-        for (auto& task : awaitable_->tasks_) {
-          task.set_barrier(&(awaitable_->barrier_));
-          awaitable_->tp_.add_task({task.get_handle(), detail::TaskLifeTime::SCOPE_MANAGED});
-        }
-      }
-
-      void await_resume() noexcept {}
-
-      WaitTasksAwaitableVector* awaitable_;
-    };
-    return Awaiter{this};
-  }
+  Awaiter operator co_await() { return Awaiter{this}; }
 
   std::vector<detail::WaitTask<detail::WaitBarrier>>& get_tasks() noexcept { return tasks_; }              
 
@@ -224,60 +279,38 @@ class WaitTasksAwaitableAsync {
                              Container&& tasks) 
       : tp_(tp),
         tasks_(std::move(tasks)),
-        barrier_{std::make_shared<detail::WaitBarrierAsync>(tasks_.size())} {
+        barrier_(new detail::WaitBarrierAsync(tasks_.size())) {
     // Set barrier in tasks and schedule individual tasks.
-    barrier_->set_barrier_pointer(&barrier_);
     for(auto& task : tasks_) {
-      task.set_barrier(barrier_.get());
+      task.set_barrier(barrier_);
       tp_.add_task({task.get_handle(), detail::TaskLifeTime::SCOPE_MANAGED});
     }
   }
 
+  WaitTasksAwaitableAsync(WaitTasksAwaitableAsync&& other) noexcept
+      : tp_(other.tp_),
+        tasks_(std::move(other.tasks_)),
+        barrier_(std::exchange(other.barrier_, nullptr)) {}
+
+  WaitTasksAwaitableAsync(const WaitTasksAwaitableAsync&) = delete;
+  WaitTasksAwaitableAsync& operator=(const WaitTasksAwaitableAsync&) = delete;
+
+  ~WaitTasksAwaitableAsync() {
+    if (barrier_ != nullptr) barrier_->release();
+  }
+
   auto operator co_await() {
     struct Awaiter {
      public:
       
       // Optimization when all tasks are finished, we do not need
       // to suspend.
-      constexpr bool await_ready() const noexcept {  
-        if (this->awaitable_->barrier_->remaining_tasks.load() == 0) {
-          // All tasks are finished 
-          return true;
-        } else {
-          return false;
-        }
-      }
+      bool await_ready() const noexcept { return awaitable_->barrier_->is_finished(); }
 
-      std::coroutine_handle<> await_suspend(std::coroutine_handle<> currently_suspended) noexcept {
-        std::shared_ptr<detail::WaitBarrierAsync> barrier = std::atomic_load(&(awaitable_->barrier_));
-        // Once we store the continuation into the barrier, 
-        // there is no guarantee that the awaiter is still alive, 
-        // so we need to store the pointer to the barrier in function stack.
-        barrier->continuation.store(currently_suspended);
-        barrier->handle_ready_.store(true);
-        int remaining_tasks = barrier->remaining_tasks.load();
-
-        if (remaining_tasks >= 1) {
-          // At least on tasks hasn't decremented the barrier. We can be 
-          // sure that the last tasks reads the set handle, given the
-          // total order, sequential consistency.
-          return std::noop_coroutine();
-        } else {
-          bool expected = true;
-          if (barrier->handle_ready_.compare_exchange_strong(
-                expected, false)) {
-            // If continuation contains a nullptr, it means that the last task
-            // took the continuation and set the nullptr. We can be sure
-            // that the coroutine will be resumed from the last task.
-            // return std::noop_coroutine();
-            return currently_suspended;
-          } else {
-            // Last task did not manage to get the stored handle, we need to resume
-            // the current coroutine.
-            // return currently_suspended;
-            return std::noop_coroutine();
-          }
-        }
+      // The coroutine is not suspended if the last task finished before
+      // the continuation was stored.
+      bool await_suspend(std::coroutine_handle<> currently_suspended) noexcept {
+        return awaitable_->barrier_->set_continuation(currently_suspended);
       }
 
       void await_resume() noexcept {}
@@ -291,48 +324,47 @@ class WaitTasksAwaitableAsync {
 
   ThreadPool& tp_;
   Container tasks_;
-  // With shared pointer we have guarantee that the barrier is destroyed
-  // only once the coroutine is resumed and the awaiter is destroyed and 
-  // when the await_suspend function ends. 
-  // This ensures that the barrier lives long enough for the synchronizatoin
-  // between tasks and that are awaited and the parent coroutine.
-  // std::atomic<std::shared_ptr<SharedBarrierAsync>> barrier_;
-  std::shared_ptr<detail::WaitBarrierAsync> barrier_;
+  // Shared with the tasks, released in the destructor.
+  detail::WaitBarrierAsync* barrier_;
 };
 
 
 // Suspends the current coroutine and waits for tasks from different pool.
-template <typename Container>
+template <typename Container, typename Results = detail::NoResults>
 class WaitTasksPoolAwaitable {
  public:
 
-  auto operator co_await() {
-    struct Awaiter {
-     public:
-      Awaiter(WaitTasksPoolAwaitable* awaitable) : awaitable_(awaitable) {}
+  struct Awaiter {
+   public:
+    Awaiter(WaitTasksPoolAwaitable* awaitable) : awaitable_(awaitable) {}
 
-      constexpr bool await_ready() const noexcept { return false; }
+    constexpr bool await_ready() const noexcept { return false; }
 
-      // Suspends current coroutine, sets barrier for all tasks, 
-      // sets continuation for the barrier(currently suspended coroutine) and 
-      // adds tasks to thread pool for execution.
-      void await_suspend(std::coroutine_handle<> currently_suspended)  {
-        awaitable_->barrier_.set_continuation(currently_suspended);
+    // Suspends current coroutine, sets barrier for all tasks, 
+    // sets continuation for the barrier(currently suspended coroutine) and 
+    // adds tasks to thread pool for execution.
+    template <typename Promise>
+    void await_suspend(std::coroutine_handle<Promise> currently_suspended)  {
+      awaitable_->barrier_.set_continuation(currently_suspended);
 
-        for (auto& task : awaitable_->tasks_) {
-          task.set_barrier(&(awaitable_->barrier_));
-          awaitable_->tp_.add_task_from_outside({task.get_handle(), detail::TaskLifeTime::SCOPE_MANAGED});
-        }
+      const std::stop_token* stop_token = detail::stop_token_of(currently_suspended);
+      for (auto& task : awaitable_->tasks_) {
+        task.set_barrier(&(awaitable_->barrier_));
+        task.inherit_stop_token(stop_token);
+        awaitable_->tp_.add_task_from_outside({task.get_handle(), detail::TaskLifeTime::SCOPE_MANAGED});
       }
+    }
 
-      // TODO : returning multiple values has to be done here.
-      void await_resume() {}
+    // Moves results of tasks passed by value out of their promises.
+    typename Results::type await_resume() {
+      return Results::collect(awaitable_->tasks_);
+    }
 
-     private:
-      WaitTasksPoolAwaitable* awaitable_;
-    };
-    return Awaiter(this);
-  }
+   private:
+    WaitTasksPoolAwaitable* awaitable_;
+  };
+
+  Awaiter operator co_await() { return Awaiter(this); }
 
   Container& get_tasks() noexcept { return tasks_; }              
 
@@ -343,32 +375,11 @@ class WaitTasksPoolAwaitable {
 
 namespace detail{
 
-template<typename BarrierType>
-inline WaitTask<BarrierType> WaitTaskPromise<BarrierType>::get_return_object() {
-  return WaitTask<BarrierType>(std::coroutine_handle<WaitTaskPromise<BarrierType>>::from_promise(*this));
-}
-
-// Used for lvalues when the task is passed by lvalue reference.
-template<typename BarrierType, typename T>
-WaitTask<BarrierType> wait_task_body_ref(T& t) {
-  co_await t;
-}
-
-// Used for rvalues, once this WaitTask is destroyed the task
-// stored in parameter list in coroutine state is also destroyed.
-// Task t lifetime is tied to this task.
-template<typename BarrierType, typename T>
-WaitTask<BarrierType> wait_task_body_val(T t) {
-  co_await t;
-}
-
+// Tasks passed by lvalue reference are only referenced, rvalue tasks are
+// moved into the WaitTask and destroyed together with it.
 template<typename BarrierType, typename T>
 inline WaitTask<BarrierType> create_wait_task(T&& t) {
-  if constexpr (std::is_reference_v<T>) {
-    return wait_task_body_ref<BarrierType>(std::forward<T>(t));
-  } else {
-    return wait_task_body_val<BarrierType>(std::forward<T>(t));
-  }
+  return WaitTask<BarrierType>(std::forward<T>(t));
 }
 
 } // namespace detail
@@ -376,10 +387,13 @@ inline WaitTask<BarrierType> create_wait_task(T&& t) {
 // TODO: maybe add a concept whether the parameter is an awaitable. So it can be 
 // co_awaited.
 // Constructs a vector of wait tasks and returns an awaitable
+// If every task is passed by value, co_await returns a tuple with their
+// results: auto [a, b] = co_await wait_tasks(foo(), bar());
 template <typename... Args>
 inline auto wait_tasks(Args&&... args) {
   constexpr size_t arr_size = sizeof...(Args);
-  return WaitTasksAwaitable<std::array<coros::detail::WaitTask<coros::detail::WaitBarrier>, arr_size>>{
+  return WaitTasksAwaitable<std::array<coros::detail::WaitTask<coros::detail::WaitBarrier>, arr_size>,
+                            detail::WaitTasksResults<Args...>>{
     *thread_my_pool, 
     {detail::create_wait_task<coros::detail::WaitBarrier>(std::forward<Args>(args))...},
     {arr_size, nullptr}};
@@ -398,6 +412,23 @@ inline auto wait_tasks(std::vector<coros::Task<T>>& tasks) {
     {vec_size, nullptr}};
 }
 
+// Tasks are moved into the awaitable, co_await returns a vector with
+// their results.
+template <typename T>
+inline auto wait_tasks(std::vector<coros::Task<T>>&& tasks) {
+  size_t vec_size = tasks.size();
+  std::vector<coros::detail::WaitTask<coros::detail::WaitBarrier>> wait_task_vec;
+  wait_task_vec.reserve(vec_size);
+  for (auto& task : tasks) {
+    wait_task_vec.push_back(detail::create_wait_task<coros::detail::WaitBarrier>(std::move(task)));
+  }
+  return WaitTasksAwaitable<std::vector<coros::detail::WaitTask<coros::detail::WaitBarrier>>,
+                            detail::VectorResults<T>>{
+    *thread_my_pool, 
+    std::move(wait_task_vec),
+    {vec_size, nullptr}};
+}
+
 template <typename... Args>
 inline auto wait_tasks_async(Args&&... args) {
   constexpr size_t arr_size = sizeof...(Args);
@@ -423,7 +454,8 @@ inline auto wait_tasks_async(std::vector<coros::Task<T>>& tasks) {
 template <typename... Args>
 inline auto wait_tasks(coros::ThreadPool& pool, Args&&... args) {
   constexpr size_t arr_size = sizeof...(Args);
-  return WaitTasksPoolAwaitable<std::array<coros::detail::WaitTask<coros::detail::WaitBarrier>, arr_size>>{
+  return WaitTasksPoolAwaitable<std::array<coros::detail::WaitTask<coros::detail::WaitBarrier>, arr_size>,
+                                detail::WaitTasksResults<Args...>>{
     pool,
     {detail::create_wait_task<coros::detail::WaitBarrier>(std::forward<Args>(args))...},
     {arr_size, nullptr}};
@@ -443,6 +475,201 @@ inline auto wait_tasks(coros::ThreadPool& pool,
     {vec_size, nullptr}};
 }
 
+template <typename T>
+inline auto wait_tasks(coros::ThreadPool& pool,
+                           std::vector<coros::Task<T>>&& tasks) {
+  size_t vec_size = tasks.size();
+  std::vector<coros::detail::WaitTask<coros::detail::WaitBarrier>> wait_task_vec;
+  wait_task_vec.reserve(vec_size);
+  for (auto& task : tasks) {
+    wait_task_vec.push_back(detail::create_wait_task<coros::detail::WaitBarrier>(std::move(task)));
+  }
+  return WaitTasksPoolAwaitable<std::vector<coros::detail::WaitTask<coros::detail::WaitBarrier>>,
+                                detail::VectorResults<T>>{
+    pool, 
+    std::move(wait_task_vec),
+    {vec_size, nullptr}};
+}
+
+// Outcome of waiting for tasks with a deadline.
+enum class WaitStatus {
+  COMPLETED, /*All tasks finished before the deadline.*/
+  TIMEOUT,   /*The deadline expired first, unfinished tasks got a stop request.*/
+};
+
+namespace detail {
+
+// Shared by the awaitable, the tasks and the timer of wait_tasks_for. The last
+// finished task and the timer race for resuming the awaiting coroutine with a
+// single CAS. The state owns the tasks, so tasks still running after the
+// deadline can outlive the awaitable, the last reference deletes the state.
+class WaitForState {
+ public:
+  explicit WaitForState(std::vector<WaitTask<WaitForState>>&& tasks)
+      : tasks_(std::move(tasks)), remaining_(tasks_.size()), references_(tasks_.size() + 2) {
+    timer_.state = this;
+    timer_.on_expire = &WaitForState::expire;
+  }
+
+  // Schedules the tasks on the current worker. Returns the handle the
+  // awaiting coroutine transfers control to.
+  std::coroutine_handle<> start(ThreadPool& tp, std::coroutine_handle<> continuation,
+                                std::chrono::steady_clock::time_point deadline,
+                                const std::stop_token* parent_token) {
+    tp_ = &tp;
+    continuation_ = continuation;
+    if (parent_token != nullptr) parent_stop_.emplace(*parent_token, ForwardStop{&stop_source_});
+    for (auto& task : tasks_) {
+      task.set_barrier(this);
+      task.set_stop_token(stop_source_.get_token());
+    }
+    tp.add_timer(timer_, deadline);
+
+    size_t queued = tasks_.size();
+    if (tp.spawn_policy() == SpawnPolicy::WORK_FIRST) queued--;
+    for (size_t i = 0; i < queued; i++) {
+      tp.add_task({tasks_[i].get_handle(), TaskLifeTime::SCOPE_MANAGED});
+    }
+    if (queued == tasks_.size()) return std::noop_coroutine();
+    return tasks_.back().get_handle();
+  }
+
+  std::coroutine_handle<> decrement_and_resume() noexcept {
+    std::coroutine_handle<> next = std::noop_coroutine();
+    if (remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1 && claim(WaitStatus::COMPLETED)) {
+      // A timer that already expired releases its reference itself.
+      if (tp_->cancel_timer(timer_)) release();
+      next = continuation_;
+    }
+    release();
+    return next;
+  }
+
+  // Called by the awaiting coroutine once it was resumed.
+  WaitStatus status() const noexcept { return status_; }
+
+  void release() noexcept {
+    if (references_.fetch_sub(1, std::memory_order_acq_rel) == 1) delete this;
+  }
+
+ private:
+  struct Timer : TimerNode {
+    WaitForState* state;
+  };
+
+  // Runs on the timer thread.
+  static void expire(TimerNode* node) {
+    WaitForState* state = static_cast<Timer*>(node)->state;
+    if (state->claim(WaitStatus::TIMEOUT)) {
+      state->stop_source_.request_stop();
+      state->tp_->add_task_from_outside({state->continuation_, TaskLifeTime::SCOPE_MANAGED});
+    }
+    state->release();
+  }
+
+  bool claim(WaitStatus status) noexcept {
+    bool expected = false;
+    if (!claimed_.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) return false;
+    status_ = status;
+    return true;
+  }
+
+  std::vector<WaitTask<WaitForState>> tasks_;
+  ThreadPool* tp_ = nullptr;
+  std::stop_source stop_source_;
+  std::optional<std::stop_callback<ForwardStop>> parent_stop_;
+  std::coroutine_handle<> continuation_ = nullptr;
+  Timer timer_;
+  std::atomic<size_t> remaining_;
+  std::atomic<bool> claimed_ = false;
+  WaitStatus status_ = WaitStatus::COMPLETED;
+  // One reference per task, one for the timer and one for the awaitable.
+  std::atomic<size_t> references_;
+};
+
+} // namespace detail
+
+// Waits for tasks until the deadline. The awaiting coroutine is resumed
+// once all tasks finished or the deadline expired, whichever comes first.
+// On expiry the unfinished tasks get a stop request (see check_cancel()) and
+// are destroyed once they finish. Tasks get the stop token of the wait, a
+// stop of the awaiting task is forwarded to them.
+class WaitTasksForAwaitable {
+ public:
+  WaitTasksForAwaitable(ThreadPool& tp, std::chrono::steady_clock::time_point deadline,
+                        std::vector<detail::WaitTask<detail::WaitForState>>&& tasks)
+      : tp_(tp), deadline_(deadline), empty_(tasks.empty()),
+        state_(new detail::WaitForState(std::move(tasks))) {}
+
+  WaitTasksForAwaitable(WaitTasksForAwaitable&& other) noexcept
+      : tp_(other.tp_), deadline_(other.deadline_), empty_(other.empty_),
+        started_(other.started_), state_(std::exchange(other.state_, nullptr)) {}
+
+  WaitTasksForAwaitable(const WaitTasksForAwaitable&) = delete;
+  WaitTasksForAwaitable& operator=(const WaitTasksForAwaitable&) = delete;
+
+  ~WaitTasksForAwaitable() {
+    if (state_ == nullptr) return;
+    // Tasks and the timer hold no references before the start.
+    if (started_) {
+      state_->release();
+    } else {
+      delete state_;
+    }
+  }
+
+  struct Awaiter {
+    // Without tasks there is nothing to wait for.
+    bool await_ready() const noexcept { return awaitable_->empty_; }
+
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> currently_suspended) {
+      awaitable_->started_ = true;
+      return awaitable_->state_->start(awaitable_->tp_, currently_suspended, awaitable_->deadline_,
+                                       detail::stop_token_of(currently_suspended));
+    }
+
+    WaitStatus await_resume() const noexcept {
+      if (awaitable_->empty_) return WaitStatus::COMPLETED;
+      return awaitable_->state_->status();
+    }
+
+    WaitTasksForAwaitable* awaitable_;
+  };
+
+  Awaiter operator co_await() { return Awaiter{this}; }
+
+ private:
+  ThreadPool& tp_;
+  std::chrono::steady_clock::time_point deadline_;
+  bool empty_;
+  bool started_ = false;
+  detail::WaitForState* state_;
+};
+
+// co_await wait_tasks_for(timeout, foo(), bar()) returns WaitStatus. Tasks
+// may keep running after the deadline, so they are passed by value.
+template <typename Rep, typename Period, typename... Args>
+requires (std::is_rvalue_reference_v<Args&&> && ...)
+inline WaitTasksForAwaitable wait_tasks_for(std::chrono::duration<Rep, Period> timeout,
+                                            Args&&... args) {
+  std::vector<detail::WaitTask<detail::WaitForState>> tasks;
+  tasks.reserve(sizeof...(Args));
+  (tasks.push_back(detail::create_wait_task<detail::WaitForState>(std::move(args))), ...);
+  return WaitTasksForAwaitable(*thread_my_pool, detail::deadline_after(timeout), std::move(tasks));
+}
+
+template <typename Rep, typename Period, typename T>
+inline WaitTasksForAwaitable wait_tasks_for(std::chrono::duration<Rep, Period> timeout,
+                                            std::vector<coros::Task<T>>&& vec) {
+  std::vector<detail::WaitTask<detail::WaitForState>> tasks;
+  tasks.reserve(vec.size());
+  for (auto& task : vec) {
+    tasks.push_back(detail::create_wait_task<detail::WaitForState>(std::move(task)));
+  }
+  return WaitTasksForAwaitable(*thread_my_pool, detail::deadline_after(timeout), std::move(tasks));
+}
+
 } // namespace coros
 
 
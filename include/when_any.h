@@ -0,0 +1,193 @@
+#ifndef COROS_INCLUDE_WHEN_ANY_H_
+#define COROS_INCLUDE_WHEN_ANY_H_
+
+#include <atomic>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <expected>
+#include <optional>
+#include <stop_token>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "task.h"
+#include "task_life_time.h"
+#include "thread_pool.h"
+
+namespace coros {
+
+// Result of co_await when_any(...), the index of the first finished task
+// and its result.
+template <typename T>
+struct WhenAnyResult {
+  size_t index;
+  std::expected<T, std::exception_ptr> result;
+};
+
+namespace detail {
+
+template <typename T>
+class WhenAnyState;
+
+// Barrier of a single task raced by when_any.
+template <typename T>
+class WhenAnyChild {
+ public:
+  std::coroutine_handle<> decrement_and_resume() noexcept { return state_->finish(index_); }
+
+  WhenAnyState<T>* state_;
+  size_t index_;
+};
+
+// Shared by the awaitable and the raced tasks. The first finished task
+// claims the win with a single CAS, requests a stop of the other tasks and
+// resumes the awaiting coroutine. The state owns the tasks, so losers can
+// outlive the awaitable, the last reference deletes the state together
+// with the task frames.
+template <typename T>
+class WhenAnyState {
+ public:
+  static constexpr size_t kNoWinner = SIZE_MAX;
+
+  explicit WhenAnyState(std::vector<Task<T>>&& tasks)
+      : tasks_(std::move(tasks)), references_(tasks_.size() + 1) {
+    children_.reserve(tasks_.size());
+    for (size_t i = 0; i < tasks_.size(); i++) children_.push_back({this, i});
+  }
+
+  // Schedules the tasks on the current worker. Returns the handle the
+  // awaiting coroutine transfers control to. A stop requested on the token of
+  // the awaiting task is forwarded to all raced tasks.
+  std::coroutine_handle<> start(ThreadPool& tp, std::coroutine_handle<> continuation,
+                                const std::stop_token* parent_token) noexcept {
+    continuation_ = continuation;
+    if (parent_token != nullptr) parent_stop_.emplace(*parent_token, ForwardStop{&stop_source_});
+    size_t queued = tasks_.size();
+    if (tp.spawn_policy() == SpawnPolicy::WORK_FIRST) queued--;
+    for (size_t i = 0; i < tasks_.size(); i++) {
+      auto& promise = tasks_[i].get_handle().promise();
+      promise.set_barrier(&children_[i]);
+      promise.set_stop_token(stop_source_.get_token());
+      if (i < queued) tp.add_task({tasks_[i].get_handle(), TaskLifeTime::SCOPE_MANAGED});
+    }
+    if (queued == tasks_.size()) return std::noop_coroutine();
+    return tasks_.back().get_handle();
+  }
+
+  std::coroutine_handle<> finish(size_t index) noexcept {
+    std::coroutine_handle<> next = std::noop_coroutine();
+    size_t expected = kNoWinner;
+    if (winner_.compare_exchange_strong(expected, index, std::memory_order_acq_rel)) {
+      stop_source_.request_stop();
+      next = continuation_;
+    }
+    release();
+    return next;
+  }
+
+  // Called by the awaiting coroutine once it was resumed by the winner.
+  WhenAnyResult<T> take_result() noexcept {
+    size_t winner = winner_.load(std::memory_order_acquire);
+    return {winner, std::move(tasks_[winner]).expected()};
+  }
+
+  void release() noexcept {
+    if (references_.fetch_sub(1, std::memory_order_acq_rel) == 1) delete this;
+  }
+
+ private:
+  std::vector<Task<T>> tasks_;
+  std::vector<WhenAnyChild<T>> children_;
+  std::stop_source stop_source_;
+  std::optional<std::stop_callback<ForwardStop>> parent_stop_;
+  std::coroutine_handle<> continuation_ = nullptr;
+  std::atomic<size_t> winner_ = kNoWinner;
+  // One reference per task and one for the awaitable.
+  std::atomic<size_t> references_;
+};
+
+} // namespace detail
+
+// Races tasks on the current pool. The awaiting coroutine is resumed as soon
+// as the first task finishes, other tasks get a stop request (see
+// coros::get_stop_token()) and are destroyed once they finish.
+//
+// coros::Task<int> foo() {
+//   auto [index, result] = co_await coros::when_any(replica(0), replica(1));
+//   co_return *result;
+// }
+template <typename T>
+class WhenAnyAwaitable {
+ public:
+  WhenAnyAwaitable(ThreadPool& tp, std::vector<Task<T>>&& tasks)
+      : tp_(tp), empty_(tasks.empty()),
+        state_(new detail::WhenAnyState<T>(std::move(tasks))) {}
+
+  WhenAnyAwaitable(WhenAnyAwaitable&& other) noexcept
+      : tp_(other.tp_), empty_(other.empty_),
+        started_(other.started_), state_(std::exchange(other.state_, nullptr)) {}
+
+  WhenAnyAwaitable(const WhenAnyAwaitable&) = delete;
+  WhenAnyAwaitable& operator=(const WhenAnyAwaitable&) = delete;
+
+  ~WhenAnyAwaitable() {
+    if (state_ == nullptr) return;
+    // Tasks that never started hold no references.
+    if (started_) {
+      state_->release();
+    } else {
+      delete state_;
+    }
+  }
+
+  struct Awaiter {
+   public:
+    // Without tasks there is nothing to wait for.
+    bool await_ready() const noexcept { return awaitable_->empty_; }
+
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> currently_suspended) noexcept {
+      awaitable_->started_ = true;
+      return awaitable_->state_->start(awaitable_->tp_, currently_suspended,
+                                       detail::stop_token_of(currently_suspended));
+    }
+
+    // Result of an empty race holds a null exception_ptr.
+    WhenAnyResult<T> await_resume() noexcept {
+      if (awaitable_->empty_) return {0, std::unexpected(std::exception_ptr{})};
+      return awaitable_->state_->take_result();
+    }
+
+    WhenAnyAwaitable* awaitable_;
+  };
+
+  Awaiter operator co_await() { return Awaiter{this}; }
+
+ private:
+  ThreadPool& tp_;
+  bool empty_;
+  bool started_ = false;
+  detail::WhenAnyState<T>* state_;
+};
+
+// Tasks are passed by value, all of them must have the same result type.
+template <typename T, typename... Rest>
+requires ((std::is_same_v<Rest, Task<T>>) && ...)
+inline WhenAnyAwaitable<T> when_any(Task<T>&& first, Rest&&... rest) {
+  std::vector<Task<T>> tasks;
+  tasks.reserve(sizeof...(Rest) + 1);
+  tasks.push_back(std::move(first));
+  (tasks.push_back(std::move(rest)), ...);
+  return WhenAnyAwaitable<T>(*thread_my_pool, std::move(tasks));
+}
+
+template <typename T>
+inline WhenAnyAwaitable<T> when_any(std::vector<Task<T>>&& tasks) {
+  return WhenAnyAwaitable<T>(*thread_my_pool, std::move(tasks));
+}
+
+} // namespace coros
+
+#endif  // COROS_INCLUDE_WHEN_ANY_H_
@@ -0,0 +1,42 @@
+#ifndef COROS_INCLUDE_YIELD_H_
+#define COROS_INCLUDE_YIELD_H_
+
+#include <coroutine>
+
+#include "thread_pool.h"
+
+namespace coros {
+
+// Suspends the awaiting coroutine and queues it behind the work already
+// queued on its worker, so a long running task lets other tasks run.
+// Outside of a pool the coroutine is not suspended.
+class YieldAwaitable {
+ public:
+  bool await_ready() const noexcept { return thread_my_pool == nullptr; }
+
+  void await_suspend(std::coroutine_handle<> handle) { thread_my_pool->requeue(handle); }
+
+  void await_resume() const noexcept {}
+};
+
+inline YieldAwaitable yield() noexcept { return {}; }
+
+// Yields only once the running task used up its budget of operations or
+// time, see ThreadPoolOptions::budget_operations and budget_time. Each call
+// consumes one operation, cheap enough to be called in inner loops.
+class ConsumeBudgetAwaitable {
+ public:
+  bool await_ready() const noexcept {
+    return thread_my_worker == nullptr || !detail::consume_budget(*thread_my_worker);
+  }
+
+  void await_suspend(std::coroutine_handle<> handle) { thread_my_pool->requeue(handle); }
+
+  void await_resume() const noexcept {}
+};
+
+inline ConsumeBudgetAwaitable consume_budget() noexcept { return {}; }
+
+} // namespace coros
+
+#endif  // COROS_INCLUDE_YIELD_H_
@@ -0,0 +1,147 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "blocking.h"
+#include "start_tasks.h"
+#include "thread_pool.h"
+#include "wait_tasks.h"
+
+namespace {
+
+using namespace std::chrono_literals;
+
+coros::Task<int> blocking_value(coros::ThreadPool*& resumed_on) {
+  auto result = co_await coros::run_blocking([]() { return 42; });
+  resumed_on = coros::thread_my_pool;
+  co_return result.value();
+}
+
+coros::Task<bool> blocking_throws() {
+  auto result = co_await coros::run_blocking([]() -> int { throw std::runtime_error("failed"); });
+  co_return !result.has_value() && result.error() != nullptr;
+}
+
+// Blocks its thread until the flag is set by a task on the worker.
+coros::Task<void> blocking_wait(std::atomic<bool>& flag) {
+  auto result = co_await coros::run_blocking([&flag]() {
+    while (!flag) std::this_thread::sleep_for(1ms);
+  });
+  EXPECT_TRUE(result.has_value());
+}
+
+coros::Task<void> set_flag(std::atomic<bool>& flag) {
+  flag = true;
+  co_return;
+}
+
+coros::Task<void> blocking_sleep(std::atomic<int>& running, std::atomic<int>& max_running) {
+  co_await coros::run_blocking([&]() {
+    int now = ++running;
+    int max = max_running;
+    while (now > max && !max_running.compare_exchange_weak(max, now)) {}
+    std::this_thread::sleep_for(10ms);
+    running--;
+  });
+}
+
+struct CountingJob : coros::detail::BlockingJob {
+  std::atomic<int>* counter;
+};
+
+void count_job(coros::detail::BlockingJob* job) {
+  std::this_thread::sleep_for(5ms);
+  (*static_cast<CountingJob*>(job)->counter)++;
+}
+
+} // namespace
+
+TEST(BlockingTest, ReturnsValueOnPool) {
+  coros::ThreadPool tp{2};
+  coros::ThreadPool* resumed_on = nullptr;
+  coros::Task<int> t = blocking_value(resumed_on);
+  coros::start_sync(tp, t);
+  EXPECT_EQ(t.value(), 42);
+  EXPECT_EQ(resumed_on, &tp);
+}
+
+TEST(BlockingTest, ExceptionAsError) {
+  coros::ThreadPool tp{1};
+  coros::Task<bool> t = blocking_throws();
+  coros::start_sync(tp, t);
+  EXPECT_TRUE(t.value());
+}
+
+// With a single worker, set_flag only runs if the worker is not blocked.
+TEST(BlockingTest, WorkerNotBlocked) {
+  coros::ThreadPool tp{1};
+  std::atomic<bool> flag = false;
+  coros::Task<void> wait = blocking_wait(flag);
+  coros::Task<void> set = set_flag(flag);
+  coros::start_sync(tp, wait, set);
+  EXPECT_TRUE(flag);
+}
+
+TEST(BlockingTest, ThreadLimit) {
+  coros::ThreadPool tp{coros::ThreadPoolOptions{.thread_count = 2, .blocking_threads = 2}};
+  std::atomic<int> running = 0;
+  std::atomic<int> max_running = 0;
+  coros::Task<void> t = [](std::atomic<int>& running, std::atomic<int>& max_running) -> coros::Task<void> {
+    std::vector<coros::Task<void>> tasks;
+    for (int i = 0; i < 8; i++) tasks.push_back(blocking_sleep(running, max_running));
+    co_await coros::wait_tasks(std::move(tasks));
+  }(running, max_running);
+  coros::start_sync(tp, t);
+  EXPECT_LE(max_running, 2);
+  EXPECT_LE(tp.blocking_thread_count(), 2u);
+}
+
+TEST(BlockingTest, IdleThreadsExit) {
+  coros::ThreadPool tp{coros::ThreadPoolOptions{.thread_count = 1,
+                                                .blocking_idle_timeout = std::chrono::milliseconds(5)}};
+  std::atomic<int> running = 0;
+  std::atomic<int> max_running = 0;
+  coros::Task<void> t = blocking_sleep(running, max_running);
+  coros::start_sync(tp, t);
+  while (tp.blocking_thread_count() != 0) std::this_thread::sleep_for(1ms);
+  // A new call starts a thread again.
+  coros::Task<void> again = blocking_sleep(running, max_running);
+  coros::start_sync(tp, again);
+  EXPECT_EQ(max_running, 1);
+}
+
+// The coroutine continues on the pool given to run_blocking.
+TEST(BlockingTest, ResumesOnGivenPool) {
+  coros::ThreadPool tp{1};
+  coros::ThreadPool tp2{1};
+  coros::Task<coros::ThreadPool*> t = [](coros::ThreadPool& tp2) -> coros::Task<coros::ThreadPool*> {
+    auto result = co_await coros::run_blocking(tp2, []() { return 1; });
+    EXPECT_EQ(result.value(), 1);
+    co_return coros::thread_my_pool;
+  }(tp2);
+  coros::start_sync(tp, t);
+  EXPECT_EQ(t.value(), &tp2);
+}
+
+// Jobs queued behind a busy thread still run when the threads are stopped.
+TEST(BlockingTest, StopRunsQueuedJobs) {
+  std::atomic<int> counter = 0;
+  std::vector<CountingJob> jobs(5);
+  for (auto& job : jobs) {
+    job.run = &count_job;
+    job.counter = &counter;
+  }
+  coros::detail::BlockingThreads threads{1, std::chrono::seconds(10)};
+  for (int i = 0; i < 4; i++) threads.submit(&jobs[i]);
+  threads.stop();
+  EXPECT_EQ(counter, 4);
+  EXPECT_EQ(threads.thread_count(), 0u);
+  // Submitted after the stop, the job runs on this thread.
+  threads.submit(&jobs[4]);
+  EXPECT_EQ(counter, 5);
+}
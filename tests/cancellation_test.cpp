@@ -0,0 +1,189 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <exception>
+#include <expected>
+#include <stop_token>
+#include <thread>
+
+#include "chain_tasks.h"
+#include "enqueue_tasks.h"
+#include "start_tasks.h"
+#include "thread_pool.h"
+#include "wait_tasks.h"
+#include "when_any.h"
+
+namespace {
+
+template <typename T>
+bool is_cancelled(const std::expected<T, std::exception_ptr>& result) {
+  if (result.has_value()) return false;
+  try {
+    std::rethrow_exception(result.error());
+  } catch (const coros::TaskCancelled&) {
+    return true;
+  } catch (...) {
+    return false;
+  }
+}
+
+coros::Task<int> count_run(std::atomic<int>& runs) {
+  runs++;
+  co_return 1;
+}
+
+coros::Task<int> check_and_add_one(int value) {
+  co_await coros::check_cancel();
+  co_return value + 1;
+}
+
+} // namespace
+
+TEST(CancellationTest, CancelledTaskDoesNotStart) {
+  coros::ThreadPool tp{1};
+  std::atomic<int> runs = 0;
+  std::stop_source source;
+
+  coros::Task<int> t = count_run(runs);
+  t.set_stop_token(source.get_token());
+  source.request_stop();
+  coros::start_sync(tp, t);
+
+  EXPECT_EQ(runs, 0);
+  EXPECT_TRUE(is_cancelled(t.expected()));
+}
+
+TEST(CancellationTest, CheckCancel) {
+  coros::ThreadPool tp{1};
+  std::stop_source source;
+  bool reached_end = false;
+
+  coros::Task<void> t = [](std::stop_source& source, bool& reached_end) -> coros::Task<void> {
+    co_await coros::check_cancel();
+    source.request_stop();
+    co_await coros::check_cancel();
+    reached_end = true;
+  }(source, reached_end);
+  t.set_stop_token(source.get_token());
+  coros::start_sync(tp, t);
+
+  EXPECT_FALSE(reached_end);
+  EXPECT_TRUE(is_cancelled(t.expected()));
+}
+
+// A task without a token is never cancelled.
+TEST(CancellationTest, CheckCancelWithoutToken) {
+  coros::ThreadPool tp{1};
+  coros::Task<int> t = check_and_add_one(1);
+  coros::start_sync(tp, t);
+  EXPECT_EQ(t.value(), 2);
+}
+
+TEST(CancellationTest, AwaitedTaskInheritsToken) {
+  coros::ThreadPool tp{1};
+  std::stop_source source;
+
+  coros::Task<int> t = [](std::stop_source& source) -> coros::Task<int> {
+    source.request_stop();
+    coros::Task<int> child = check_and_add_one(1);
+    co_await child;
+    EXPECT_TRUE(is_cancelled(child.expected()));
+    co_return 0;
+  }(source);
+  t.set_stop_token(source.get_token());
+  coros::start_sync(tp, t);
+
+  EXPECT_EQ(t.value(), 0);
+}
+
+TEST(CancellationTest, WaitTasksChildrenInheritToken) {
+  coros::ThreadPool tp{2};
+  std::atomic<int> runs = 0;
+  std::stop_source source;
+
+  coros::Task<int> t = [](std::stop_source& source, std::atomic<int>& runs) -> coros::Task<int> {
+    source.request_stop();
+    coros::Task<int> a = count_run(runs);
+    coros::Task<int> b = count_run(runs);
+    co_await coros::wait_tasks(a, b);
+    EXPECT_TRUE(is_cancelled(a.expected()));
+    EXPECT_TRUE(is_cancelled(b.expected()));
+    co_return 0;
+  }(source, runs);
+  t.set_stop_token(source.get_token());
+  coros::start_sync(tp, t);
+
+  EXPECT_EQ(t.value(), 0);
+  EXPECT_EQ(runs, 0);
+}
+
+// Children with their own token keep it.
+TEST(CancellationTest, OwnTokenIsKept) {
+  coros::ThreadPool tp{2};
+  std::atomic<int> runs = 0;
+  std::stop_source source;
+
+  coros::Task<int> t = [](std::stop_source& source, std::atomic<int>& runs) -> coros::Task<int> {
+    source.request_stop();
+    std::stop_source child_source;
+    coros::Task<int> a = count_run(runs);
+    a.set_stop_token(child_source.get_token());
+    co_await coros::wait_tasks(a);
+    EXPECT_EQ(*a, 1);
+    co_return 0;
+  }(source, runs);
+  t.set_stop_token(source.get_token());
+  coros::start_sync(tp, t);
+
+  EXPECT_EQ(runs, 1);
+}
+
+TEST(CancellationTest, ChainStagesInheritToken) {
+  coros::ThreadPool tp{1};
+  std::stop_source source;
+
+  coros::Task<int> t = [](std::stop_source& source) -> coros::Task<int> {
+    auto first = co_await coros::chain_tasks(1).and_then(check_and_add_one);
+    EXPECT_EQ(*first, 2);
+    source.request_stop();
+    auto second = co_await coros::chain_tasks(1).and_then(check_and_add_one);
+    EXPECT_TRUE(is_cancelled(second));
+    co_return 0;
+  }(source);
+  t.set_stop_token(source.get_token());
+  coros::start_sync(tp, t);
+
+  EXPECT_EQ(t.value(), 0);
+}
+
+// A stop of the awaiting task reaches all raced tasks.
+TEST(CancellationTest, WhenAnyForwardsStop) {
+  coros::ThreadPool tp{1};
+  std::stop_source source;
+
+  coros::Task<int> t = [](std::stop_source& source) -> coros::Task<int> {
+    source.request_stop();
+    auto [index, result] = co_await coros::when_any(check_and_add_one(1), check_and_add_one(2));
+    EXPECT_TRUE(is_cancelled(result));
+    co_return 0;
+  }(source);
+  t.set_stop_token(source.get_token());
+  coros::start_sync(tp, t);
+
+  EXPECT_EQ(t.value(), 0);
+}
+
+TEST(CancellationTest, EnqueueWithToken) {
+  std::atomic<int> runs = 0;
+  std::stop_source source;
+  source.request_stop();
+  {
+    coros::ThreadPool tp{1};
+    coros::Task<void> t = [](std::stop_token token, std::atomic<int>& runs) -> coros::Task<void> {
+      coros::enqueue_tasks(token, count_run(runs), count_run(runs));
+      co_return;
+    }(source.get_token(), runs);
+    coros::start_sync(tp, t);
+  }
+  EXPECT_EQ(runs, 0);
+}
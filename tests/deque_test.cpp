@@ -119,3 +119,49 @@ TEST(DequeTest, DestructionTask) {
   EXPECT_EQ(coros::detail::SimplePromise<int>::instance_count(), 0);
 }
 
+TEST(DequeTest, StealBatch) {
+  std::unique_ptr<coros::detail::Dequeue> victim = std::make_unique<coros::detail::Dequeue>();
+  std::unique_ptr<coros::detail::Dequeue> thief = std::make_unique<coros::detail::Dequeue>();
+  for (int i = 0; i < 10; i++) {
+    victim->pushBottom({std::noop_coroutine(), coros::detail::TaskLifeTime::NOOP});
+  }
+
+  // Half of the tasks is taken, one returned and the rest moved to the thief.
+  EXPECT_TRUE(victim->steal_batch(*thief).has_value());
+  EXPECT_EQ(victim->size(), 5);
+  EXPECT_EQ(thief->size(), 4);
+
+  // Batch size is limited by max_tasks.
+  EXPECT_TRUE(victim->steal_batch(*thief, 2).has_value());
+  EXPECT_EQ(victim->size(), 3);
+  EXPECT_EQ(thief->size(), 5);
+
+  std::unique_ptr<coros::detail::Dequeue> empty = std::make_unique<coros::detail::Dequeue>();
+  EXPECT_FALSE(empty->steal_batch(*thief).has_value());
+}
+
+TEST(DequeTest, ConcurrentPopStealBatch) {
+  std::unique_ptr<coros::detail::Dequeue> q = std::make_unique<coros::detail::Dequeue>();
+  std::unique_ptr<coros::detail::Dequeue> thief_q = std::make_unique<coros::detail::Dequeue>();
+  constexpr int kTasks = 10'000;
+  std::atomic<int> taken = 0;
+
+  std::thread owner([&](){
+    for (int i = 0; i < kTasks; i++) {
+      q->pushBottom({std::noop_coroutine(), coros::detail::TaskLifeTime::NOOP});
+      if (i % 3 == 0 && q->popBottom().has_value()) taken++;
+    }
+    while (q->popBottom().has_value()) taken++;
+  });
+
+  std::thread thief([&](){
+    while (taken.load() + static_cast<int>(thief_q->size()) < kTasks) {
+      if (q->steal_batch(*thief_q).has_value()) taken++;
+      while (thief_q->popBottom().has_value()) taken++;
+    }
+  });
+
+  owner.join();
+  thief.join();
+  EXPECT_EQ(taken.load(), kTasks);
+}
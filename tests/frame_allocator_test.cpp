@@ -0,0 +1,281 @@
+#include "frame_allocator.h"
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <memory_resource>
+#include <thread>
+#include <vector>
+
+#include "task.h"
+#include "thread_pool.h"
+#include "start_tasks.h"
+#include "wait_tasks.h"
+#include "enqueue_tasks.h"
+#include "chain_tasks.h"
+
+#ifndef COROS_GLOBAL_FRAME_ALLOCATOR_
+
+TEST(FrameAllocatorTest, LocalReuse) {
+  void* first = coros::detail::allocate_frame(100);
+  coros::detail::deallocate_frame(first);
+  void* second = coros::detail::allocate_frame(90);
+  EXPECT_EQ(first, second);
+  coros::detail::deallocate_frame(second);
+}
+
+TEST(FrameAllocatorTest, Alignment) {
+  for (size_t size : {1, 17, 100, 500, 2000, 5000}) {
+    void* frame = coros::detail::allocate_frame(size);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(frame) % __STDCPP_DEFAULT_NEW_ALIGNMENT__, 0);
+    coros::detail::deallocate_frame(frame);
+  }
+}
+
+TEST(FrameAllocatorTest, RemoteFree) {
+  std::vector<void*> frames;
+  std::jthread owner([&] {
+    for (int i = 0; i < 64; i++) frames.push_back(coros::detail::allocate_frame(1400));
+  });
+  owner.join();
+
+  // Frames freed by a different thread are returned to the remote free
+  // list of the arena they came from.
+  std::jthread other([&] {
+    for (void* frame : frames) coros::detail::deallocate_frame(frame);
+  });
+  other.join();
+
+  // The arena of the exited thread is adopted and reuses the frames. The size
+  // class is not used by task frames, so the local free list is empty.
+  std::vector<void*> reused;
+  std::jthread adopter([&] {
+    for (int i = 0; i < 64; i++) reused.push_back(coros::detail::allocate_frame(1400));
+    for (void* frame : reused) coros::detail::deallocate_frame(frame);
+  });
+  adopter.join();
+
+  std::sort(frames.begin(), frames.end());
+  std::sort(reused.begin(), reused.end());
+  EXPECT_EQ(frames, reused);
+}
+
+#endif
+
+namespace {
+coros::Task<int> sum(int depth) {
+  if (depth == 0) co_return 1;
+  coros::Task<int> a = sum(depth - 1);
+  coros::Task<int> b = sum(depth - 1);
+  co_await coros::wait_tasks(a, b);
+  co_return *a + *b;
+}
+}
+
+// Frames are allocated and freed on different workers.
+TEST(FrameAllocatorTest, TasksAcrossWorkers) {
+  coros::ThreadPool tp{4};
+  for (int i = 0; i < 10; i++) {
+    coros::Task<int> t = sum(12);
+    coros::start_sync(tp, t);
+    EXPECT_EQ(*t, 4096);
+  }
+}
+
+#ifndef COROS_GLOBAL_FRAME_ALLOCATOR_
+
+TEST(FrameAllocatorTest, StackLifo) {
+  void* a = coros::detail::allocate_stacked_frame(100);
+  void* b = coros::detail::allocate_stacked_frame(100);
+  EXPECT_LT(a, b);
+  coros::detail::deallocate_frame(b);
+  void* c = coros::detail::allocate_stacked_frame(100);
+  EXPECT_EQ(b, c);
+  coros::detail::deallocate_frame(c);
+  coros::detail::deallocate_frame(a);
+}
+
+TEST(FrameAllocatorTest, StackOutOfOrder) {
+  void* a = coros::detail::allocate_stacked_frame(100);
+  void* b = coros::detail::allocate_stacked_frame(100);
+  // Not on the top, only marked as freed.
+  coros::detail::deallocate_frame(a);
+  void* c = coros::detail::allocate_stacked_frame(100);
+  EXPECT_GT(c, b);
+  coros::detail::deallocate_frame(c);
+  // Pops b and the already freed a.
+  coros::detail::deallocate_frame(b);
+  void* d = coros::detail::allocate_stacked_frame(100);
+  EXPECT_EQ(a, d);
+  coros::detail::deallocate_frame(d);
+}
+
+TEST(FrameAllocatorTest, StackRemoteFree) {
+  void* a = coros::detail::allocate_stacked_frame(100);
+  std::jthread other([&] { coros::detail::deallocate_frame(a); });
+  other.join();
+  void* b = coros::detail::allocate_stacked_frame(100);
+  EXPECT_EQ(a, b);
+  coros::detail::deallocate_frame(b);
+}
+
+TEST(FrameAllocatorTest, StackFallback) {
+  // Frames beyond the stack limit and frames larger than a segment are
+  // allocated from the slabs or the global allocator.
+  std::vector<void*> frames;
+  size_t limit = coros::detail::kFrameStackSegmentSize * coros::detail::kMaxFrameStackSegments;
+  for (size_t allocated = 0; allocated < 2 * limit; allocated += 1000) {
+    frames.push_back(coros::detail::allocate_stacked_frame(1000));
+  }
+  frames.push_back(coros::detail::allocate_stacked_frame(2 * coros::detail::kFrameStackSegmentSize));
+  while (!frames.empty()) {
+    coros::detail::deallocate_frame(frames.back());
+    frames.pop_back();
+  }
+  void* a = coros::detail::allocate_stacked_frame(100);
+  void* b = coros::detail::allocate_stacked_frame(100);
+  coros::detail::deallocate_frame(b);
+  EXPECT_EQ(b, coros::detail::allocate_stacked_frame(100));
+  coros::detail::deallocate_frame(b);
+  coros::detail::deallocate_frame(a);
+}
+
+#endif
+
+namespace {
+
+// Counts allocations forwarded to the default resource.
+class CountingResource : public std::pmr::memory_resource {
+ public:
+  std::atomic<int> allocations = 0;
+  std::atomic<int> live = 0;
+
+ private:
+  void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+    allocations++;
+    live++;
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+  }
+
+  void do_deallocate(void* ptr, std::size_t bytes, std::size_t alignment) override {
+    live--;
+    std::pmr::new_delete_resource()->deallocate(ptr, bytes, alignment);
+  }
+
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+    return this == &other;
+  }
+};
+
+coros::Task<int> leaf(std::allocator_arg_t, std::pmr::memory_resource*, int value) {
+  co_return value;
+}
+
+coros::Task<int> add_one(int value) {
+  co_return value + 1;
+}
+
+struct Handler {
+  coros::Task<int> handle(std::allocator_arg_t, std::pmr::polymorphic_allocator<int>, int value) {
+    co_return value + offset;
+  }
+  int offset = 10;
+};
+
+}
+
+TEST(FrameAllocatorTest, MemoryResource) {
+  CountingResource resource;
+  {
+    coros::Task<int> t = leaf(std::allocator_arg, &resource, 42);
+    EXPECT_EQ(resource.allocations, 1);
+    t.get_handle().resume();
+    EXPECT_EQ(*t, 42);
+  }
+  EXPECT_EQ(resource.live, 0);
+}
+
+TEST(FrameAllocatorTest, AllocatorOfMemberFunction) {
+  CountingResource resource;
+  Handler handler;
+  {
+    coros::Task<int> t = handler.handle(std::allocator_arg,
+                                        std::pmr::polymorphic_allocator<int>(&resource), 1);
+    auto lambda = [](std::allocator_arg_t, std::allocator<int>) -> coros::Task<int> { co_return 2; };
+    coros::Task<int> l = lambda(std::allocator_arg, std::allocator<int>{});
+    EXPECT_EQ(resource.allocations, 1);
+    t.get_handle().resume();
+    l.get_handle().resume();
+    EXPECT_EQ(*t, 11);
+    EXPECT_EQ(*l, 2);
+  }
+  EXPECT_EQ(resource.live, 0);
+}
+
+// Monotonic arena for a whole task tree, released in one shot.
+TEST(FrameAllocatorTest, MonotonicArena) {
+  CountingResource upstream;
+  {
+    std::pmr::monotonic_buffer_resource arena(&upstream);
+    coros::Task<int> t = leaf(std::allocator_arg, &arena, 7);
+    t.get_handle().resume();
+    EXPECT_EQ(*t, 7);
+  }
+  EXPECT_GT(upstream.allocations, 0);
+  EXPECT_EQ(upstream.live, 0);
+}
+
+TEST(FrameAllocatorTest, WaitTasksWithAllocator) {
+  coros::ThreadPool tp{2};
+  CountingResource resource;
+  coros::Task<int> t = [](CountingResource& resource) -> coros::Task<int> {
+    coros::Task<int> a = leaf(std::allocator_arg, &resource, 1);
+    coros::Task<int> b = leaf(std::allocator_arg, &resource, 2);
+    co_await coros::wait_tasks(a, b);
+    co_return *a + *b;
+  }(resource);
+  coros::start_sync(tp, t);
+  EXPECT_EQ(*t, 3);
+  // Only the tasks, wait_tasks does not create wrapper frames.
+  EXPECT_EQ(resource.allocations, 2);
+  EXPECT_EQ(resource.live, 0);
+}
+
+TEST(FrameAllocatorTest, EnqueueTasksForwardAllocator) {
+  CountingResource resource;
+  {
+    coros::ThreadPool tp{2};
+    coros::enqueue_tasks(tp, leaf(std::allocator_arg, &resource, 1));
+    for (int i = 0; i < 1000 && resource.live != 0; i++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+  // The task and its NoWaitTask wrapper.
+  EXPECT_EQ(resource.allocations, 2);
+  EXPECT_EQ(resource.live, 0);
+}
+
+TEST(FrameAllocatorTest, ChainTasksResource) {
+  CountingResource resource;
+  coros::Task<int> t = [](CountingResource& resource) -> coros::Task<int> {
+    auto res = co_await coros::chain_tasks(std::allocator_arg, &resource, 40).and_then(add_one);
+    co_return *res + 1;
+  }(resource);
+  t.get_handle().resume();
+  EXPECT_EQ(*t, 42);
+  EXPECT_GT(resource.allocations, 0);
+  EXPECT_EQ(resource.live, 0);
+
+  // A chain started with a task uses the allocator of the task.
+  int allocations = resource.allocations;
+  coros::Task<int> u = [](CountingResource& resource) -> coros::Task<int> {
+    auto res = co_await coros::chain_tasks(leaf(std::allocator_arg, &resource, 1)).and_then(add_one);
+    co_return *res;
+  }(resource);
+  u.get_handle().resume();
+  EXPECT_EQ(*u, 2);
+  EXPECT_GT(resource.allocations, allocations + 1);
+  EXPECT_EQ(resource.live, 0);
+}
@@ -0,0 +1,112 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "periodic.h"
+#include "thread_pool.h"
+
+namespace {
+
+using namespace std::chrono_literals;
+using Clock = std::chrono::steady_clock;
+
+coros::Task<void> count_tick(std::atomic<int>& ticks) {
+  ticks++;
+  co_return;
+}
+
+} // namespace
+
+TEST(PeriodicTest, NextTickOnTime) {
+  Clock::time_point deadline{100ms};
+  for (auto policy : {coros::PeriodicPolicy::DRIFT_FREE, coros::PeriodicPolicy::CATCH_UP,
+                      coros::PeriodicPolicy::SKIP_MISSED}) {
+    auto tick = coros::detail::next_periodic_tick(deadline, deadline + 3ms, 10ms, policy);
+    EXPECT_TRUE(tick.run);
+    // Stays on the grid, the lateness does not drift the schedule.
+    EXPECT_EQ(tick.next, Clock::time_point{110ms});
+  }
+}
+
+TEST(PeriodicTest, NextTickMissed) {
+  Clock::time_point deadline{100ms};
+  // Late by two and a half periods.
+  Clock::time_point now{125ms};
+
+  auto drift_free = coros::detail::next_periodic_tick(deadline, now, 10ms,
+                                                      coros::PeriodicPolicy::DRIFT_FREE);
+  EXPECT_TRUE(drift_free.run);
+  EXPECT_EQ(drift_free.next, Clock::time_point{130ms});
+
+  auto catch_up = coros::detail::next_periodic_tick(deadline, now, 10ms,
+                                                    coros::PeriodicPolicy::CATCH_UP);
+  EXPECT_TRUE(catch_up.run);
+  EXPECT_EQ(catch_up.next, Clock::time_point{110ms});
+
+  auto skip = coros::detail::next_periodic_tick(deadline, now, 10ms,
+                                                coros::PeriodicPolicy::SKIP_MISSED);
+  EXPECT_FALSE(skip.run);
+  EXPECT_EQ(skip.next, Clock::time_point{130ms});
+}
+
+TEST(PeriodicTest, RunsUntilStopped) {
+  std::atomic<int> ticks = 0;
+  coros::ThreadPool tp{1};
+  coros::PeriodicSchedule schedule = tp.schedule_every(2ms, [&ticks]() { return count_tick(ticks); });
+  while (ticks < 5) std::this_thread::yield();
+  schedule.stop();
+  // A tick spawned right before the stop may still run.
+  std::this_thread::sleep_for(10ms);
+  int stopped_at = ticks;
+  std::this_thread::sleep_for(20ms);
+  EXPECT_EQ(ticks, stopped_at);
+}
+
+// Schedules share the timer thread of the pool.
+TEST(PeriodicTest, ManySchedules) {
+  constexpr int kSchedules = 200;
+  std::vector<std::atomic<int>> ticks(kSchedules);
+  coros::ThreadPool tp{2};
+  std::vector<coros::PeriodicSchedule> schedules;
+  for (int i = 0; i < kSchedules; i++) {
+    schedules.push_back(tp.schedule_every(5ms, [&ticks, i]() { return count_tick(ticks[i]); }));
+  }
+  for (auto& count : ticks) {
+    while (count < 2) std::this_thread::yield();
+  }
+  // Schedules are stopped from several threads while their timers fire.
+  constexpr int kStoppers = 4;
+  std::vector<std::thread> stoppers;
+  for (int t = 0; t < kStoppers; t++) {
+    stoppers.emplace_back([&schedules, t]() {
+      for (size_t i = t; i < schedules.size(); i += kStoppers) schedules[i].stop();
+    });
+  }
+  for (auto& stopper : stoppers) stopper.join();
+  schedules.clear();
+}
+
+// Stops a schedule right after its timer is armed again, many times.
+TEST(PeriodicTest, StopWhileExpiring) {
+  std::atomic<int> ticks = 0;
+  coros::ThreadPool tp{2};
+  for (int round = 0; round < 50; round++) {
+    std::vector<coros::PeriodicSchedule> schedules;
+    for (int i = 0; i < 20; i++) {
+      schedules.push_back(tp.schedule_every(1ms, [&ticks]() { return count_tick(ticks); }));
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(500 + 50 * round));
+    std::vector<std::thread> stoppers;
+    for (int t = 0; t < 4; t++) {
+      stoppers.emplace_back([&schedules, t]() {
+        for (size_t i = t; i < schedules.size(); i += 4) schedules[i].stop();
+      });
+    }
+    for (auto& stopper : stoppers) stopper.join();
+  }
+  // Ticks spawned right before a stop may still run.
+  std::this_thread::sleep_for(10ms);
+}
@@ -1,4 +1,7 @@
 #include <gtest/gtest.h>
+#include <chrono>
+#include <thread>
+
 #include "thread_pool.h"
 
 #include "start_tasks.h"
@@ -149,3 +152,34 @@ TEST(StartingTaskTest, SyncWaitLambda) {
 
 
 
+
+namespace {
+
+coros::Task<void> until_cancelled() {
+  while (true) {
+    co_await coros::check_cancel();
+    std::this_thread::yield();
+  }
+}
+
+} // namespace
+
+TEST(StartingTaskTest, SyncForCompleted) {
+  coros::ThreadPool tp{1};
+  auto status = coros::start_sync_for(tp, std::chrono::seconds(10),
+                                      []() -> coros::Task<int> { co_return 42; }());
+  EXPECT_EQ(status, coros::WaitStatus::COMPLETED);
+}
+
+// The caller returns at the deadline, the task is cancelled and destroyed
+// in the pool afterwards.
+TEST(StartingTaskTest, SyncForTimeout) {
+  coros::ThreadPool tp{1};
+  auto start = std::chrono::steady_clock::now();
+  auto status = coros::start_sync_for(tp, std::chrono::milliseconds(20), until_cancelled());
+  EXPECT_EQ(status, coros::WaitStatus::TIMEOUT);
+  EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(20));
+  while (coros::detail::WaitTask<coros::detail::WaitBarrier>::instance_count() > 0) {
+    std::this_thread::yield();
+  }
+}
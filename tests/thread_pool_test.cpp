@@ -1,8 +1,13 @@
 #include "thread_pool.h"
 #include <gtest/gtest.h>
 
+#include <atomic>
+#include <chrono>
+#include <thread>
+
 #include "wait_tasks.h"
 #include "start_tasks.h"
+#include "enqueue_tasks.h"
 
 namespace {
 coros::Task<int> fib(coros::ThreadPool& tp, int index) {
@@ -30,3 +35,255 @@ TEST(ThreadPoolTest, Fib) {
   coros::start_sync(tp, t);
   EXPECT_EQ(*t, 6765);
 }
+
+TEST(ThreadPoolTest, IdleWorkersPark) {
+  coros::ThreadPool tp{2};
+
+  // Give workers time to go through the spin and yield phases.
+  for (int i = 0; i < 100 && tp.parked_workers() != 2; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_EQ(tp.parked_workers(), 2);
+
+  // Parked workers are woken up by new work.
+  coros::Task<int> t = fib(tp, 15);
+  coros::start_sync(tp, t);
+  EXPECT_EQ(*t, 610);
+}
+
+TEST(ThreadPoolTest, SearchingWorkersLimit) {
+  coros::ThreadPool tp{8};
+  EXPECT_EQ(tp.max_searching_workers(), 4);
+
+  // Parked workers do not search, the slots are only taken here.
+  for (int i = 0; i < 100 && tp.parked_workers() != 8; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ASSERT_EQ(tp.parked_workers(), 8);
+  for (int i = 0; i < 4; i++) EXPECT_TRUE(tp.test_try_start_searching());
+  // A fifth thief backs off.
+  EXPECT_FALSE(tp.test_try_start_searching());
+  EXPECT_EQ(tp.searching_workers(), 4);
+  for (int i = 0; i < 3; i++) EXPECT_FALSE(tp.test_stop_searching());
+  // Only the last searcher is told to wake up another worker.
+  EXPECT_TRUE(tp.test_stop_searching());
+
+  coros::Task<int> t = fib(tp, 20);
+  coros::start_sync(tp, t);
+  EXPECT_EQ(*t, 6765);
+  // Work was stolen, so the last searcher woke up other workers.
+  EXPECT_GE(tp.searcher_wakeups(), 1u);
+
+  coros::ThreadPool tp_single{1};
+  EXPECT_EQ(tp_single.max_searching_workers(), 1);
+}
+
+TEST(ThreadPoolTest, PinningCpuList) {
+  int cpu = coros::detail::allowed_cpus().front();
+  coros::ThreadPool tp{{.thread_count = 2, .pinning = coros::Pinning::CPU_LIST, .cpus = {cpu}}};
+  EXPECT_EQ(tp.worker_cpu(0), cpu);
+  EXPECT_EQ(tp.worker_cpu(1), cpu);
+
+  coros::Task<int> t = fib(tp, 15);
+  coros::start_sync(tp, t);
+  EXPECT_EQ(*t, 610);
+}
+
+// A CPU outside of the affinity mask leaves its worker unpinned.
+TEST(ThreadPoolTest, PinningInvalidCpu) {
+  int cpu = coros::detail::allowed_cpus().front();
+  coros::ThreadPool tp{{.thread_count = 2,
+                        .pinning = coros::Pinning::CPU_LIST,
+                        .cpus = {cpu, 100000},
+                        .topology_aware = true}};
+  EXPECT_EQ(tp.worker_cpu(0), cpu);
+  EXPECT_EQ(tp.worker_cpu(1), -1);
+  EXPECT_EQ(tp.worker_numa_node(1), -1);
+
+  // The unpinned worker is not tiered next to the pinned one.
+  auto topology = coros::detail::compute_worker_topology({cpu, -1}, true);
+  EXPECT_EQ(topology[1].package, -1);
+  EXPECT_EQ(topology[1].core, -1);
+  EXPECT_EQ(topology[1].l3, -1);
+  EXPECT_EQ(coros::detail::cpu_distance(topology[0], topology[1]), coros::detail::CpuDistance::REMOTE);
+
+  coros::Task<int> t = fib(tp, 15);
+  coros::start_sync(tp, t);
+  EXPECT_EQ(*t, 610);
+}
+
+TEST(ThreadPoolTest, PinningPolicies) {
+  std::vector<int> allowed = coros::detail::allowed_cpus();
+  for (auto pinning : {coros::Pinning::COMPACT, coros::Pinning::SCATTER,
+                       coros::Pinning::AFFINITY_MASK}) {
+    coros::ThreadPool tp{{.thread_count = 2, .pinning = pinning}};
+    for (int cpu : tp.worker_cpus()) {
+      EXPECT_NE(std::find(allowed.begin(), allowed.end(), cpu), allowed.end());
+    }
+  }
+
+  coros::ThreadPool tp{2};
+  EXPECT_EQ(tp.worker_cpu(0), -1);
+  EXPECT_EQ(tp.worker_cpu(1), -1);
+}
+
+TEST(ThreadPoolTest, NumaAware) {
+  coros::ThreadPool tp{{.thread_count = 4, .numa_aware = true, .numa_local_attempts = 2}};
+  for (size_t i = 0; i < 4; i++) {
+    // Unpinned NUMA aware workers are scattered across nodes.
+    EXPECT_GE(tp.worker_cpu(i), 0);
+    EXPECT_GE(tp.worker_numa_node(i), 0);
+  }
+
+  coros::Task<int> t = fib(tp, 20);
+  coros::start_sync(tp, t);
+  EXPECT_EQ(*t, 6765);
+}
+
+TEST(ThreadPoolTest, TopologyAware) {
+  coros::ThreadPool tp{{.thread_count = 4, .topology_aware = true}};
+  for (size_t i = 0; i < 4; i++) {
+    EXPECT_GE(tp.worker_cpu(i), 0);
+  }
+
+  coros::Task<int> t = fib(tp, 20);
+  coros::start_sync(tp, t);
+  EXPECT_EQ(*t, 6765);
+}
+
+TEST(ThreadPoolTest, InjectionPlacement) {
+  for (auto placement : {coros::InjectionPlacement::ROUND_ROBIN,
+                         coros::InjectionPlacement::LEAST_LOADED}) {
+    coros::ThreadPool tp{{.thread_count = 2, .injection_placement = placement}};
+    std::atomic<int> counter = 0;
+    std::vector<coros::Task<void>> tasks;
+    for (int i = 0; i < 1000; i++) {
+      tasks.push_back([](std::atomic<int>& counter) -> coros::Task<void> {
+        counter++;
+        co_return;
+      }(counter));
+    }
+    coros::enqueue_tasks(tp, std::move(tasks));
+
+    while (counter.load() != 1000) {
+      std::this_thread::yield();
+    }
+    EXPECT_EQ(counter.load(), 1000);
+  }
+}
+
+namespace {
+// Counts the finished leaves, fib(n) has fib(n + 1) of them.
+coros::Task<int> counting_fib(std::atomic<int>& leaves, int index) {
+  if (index <= 1) {
+    leaves++;
+    co_return index;
+  }
+
+  coros::Task<int> a = counting_fib(leaves, index - 1);
+  coros::Task<int> b = counting_fib(leaves, index - 2);
+
+  co_await coros::wait_tasks(a, b);
+
+  co_return *a + *b;
+}
+}
+
+TEST(ThreadPoolTest, InjectedTasksNotStarved) {
+  coros::ThreadPool tp{{.thread_count = 1, .injection_poll_interval = 8}};
+  constexpr int kLeaves = 121393;
+  std::atomic<int> leaves = 0;
+  std::atomic<int> leaves_seen = -1;
+  std::atomic<bool> fib_started = false;
+
+  coros::Task<int> t = [](std::atomic<int>& leaves, std::atomic<bool>& started) -> coros::Task<int> {
+    started = true;
+    coros::Task<int> f = counting_fib(leaves, 25);
+    co_await f;
+    co_return *f;
+  }(leaves, fib_started);
+  auto bt = coros::start_async(tp, t);
+  while (!fib_started) std::this_thread::yield();
+
+  coros::enqueue_tasks(tp, [](std::atomic<int>& leaves, std::atomic<int>& leaves_seen) -> coros::Task<void> {
+    leaves_seen = leaves.load();
+    co_return;
+  }(leaves, leaves_seen));
+
+  bt.wait();
+  while (leaves_seen == -1) std::this_thread::yield();
+
+  // The injected task ran while the deep recursion was still in progress.
+  EXPECT_LT(leaves_seen.load(), kLeaves);
+  EXPECT_EQ(*t, 75025);
+  EXPECT_EQ(leaves.load(), kLeaves);
+  EXPECT_GE(tp.injection_latency(0).tasks, 2);
+  EXPECT_GE(tp.injection_latency(0).max, tp.injection_latency(0).total / tp.injection_latency(0).tasks);
+}
+
+namespace {
+coros::Task<void> ping_pong(std::atomic<int>& counter, int remaining) {
+  counter++;
+  if (remaining > 0) {
+    coros::enqueue_tasks(ping_pong(counter, remaining - 1));
+  }
+  co_return;
+}
+}
+
+TEST(ThreadPoolTest, LifoSlotStarvationCap) {
+  coros::ThreadPool tp{{.thread_count = 1, .lifo_slot_cap = 3}};
+  std::atomic<int> counter = 0;
+  std::atomic<int> observed = -1;
+
+  coros::start_sync(tp, [](std::atomic<int>& counter, std::atomic<int>& observed) -> coros::Task<void> {
+    // Observer waits in the deque, while the ping pong chain uses the LIFO slot.
+    coros::enqueue_tasks([](std::atomic<int>& counter, std::atomic<int>& observed) -> coros::Task<void> {
+      observed = counter.load();
+      co_return;
+    }(counter, observed));
+    coros::enqueue_tasks(ping_pong(counter, 10'000));
+    co_return;
+  }(counter, observed));
+
+  while (counter.load() != 10'001 || observed.load() == -1) {
+    std::this_thread::yield();
+  }
+  // The chain could not monopolize the worker.
+  EXPECT_LT(observed.load(), 10'001);
+}
+
+namespace {
+coros::Task<int> hop_between(coros::ThreadPool& first, coros::ThreadPool& second, int hops) {
+  int on_expected_pool = 0;
+  for (int i = 0; i < hops; i++) {
+    co_await second.schedule();
+    if (coros::thread_my_pool == &second) on_expected_pool++;
+    co_await coros::resume_on(first);
+    if (coros::thread_my_pool == &first) on_expected_pool++;
+    // Already on the pool, the coroutine is not suspended.
+    co_await coros::resume_on(first);
+    if (coros::thread_my_pool == &first) on_expected_pool++;
+  }
+  co_return on_expected_pool;
+}
+}
+
+TEST(ThreadPoolTest, ScheduleOnOtherPool) {
+  coros::ThreadPool first{2};
+  coros::ThreadPool second{2};
+  coros::Task<int> t = hop_between(first, second, 100);
+  coros::start_sync(first, t);
+  EXPECT_EQ(*t, 300);
+}
+
+TEST(ThreadPoolTest, ScheduleOnSamePool) {
+  coros::ThreadPool tp{2};
+  auto reschedule = [](coros::ThreadPool& tp) -> coros::Task<int> {
+    for (int i = 0; i < 100; i++) co_await tp.schedule_this_task();
+    co_return coros::thread_my_pool == &tp ? 1 : 0;
+  };
+  coros::Task<int> t = reschedule(tp);
+  coros::start_sync(tp, t);
+  EXPECT_EQ(*t, 1);
+}
@@ -0,0 +1,134 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "sleep.h"
+#include "start_tasks.h"
+#include "thread_pool.h"
+#include "timer_wheel.h"
+#include "wait_tasks.h"
+
+namespace {
+
+using coros::detail::TimerNode;
+using coros::detail::TimerWheel;
+
+// Advances the wheel and returns the expiry ticks of the expired timers.
+std::vector<uint64_t> advance(TimerWheel& wheel, uint64_t to_tick) {
+  std::vector<uint64_t> expired;
+  wheel.advance(to_tick, [&](TimerNode* node) {
+    EXPECT_GE(wheel.current_tick(), node->expires);
+    expired.push_back(node->expires);
+  });
+  return expired;
+}
+
+coros::Task<int> sleep_and_return(std::chrono::milliseconds duration, int value) {
+  co_await coros::sleep_for(duration);
+  co_return value;
+}
+
+} // namespace
+
+TEST(TimerWheelTest, ExpiresInTickOrder) {
+  TimerWheel wheel;
+  // Timers on every level and in the overflow list.
+  std::vector<uint64_t> ticks = {1, 63, 64, 65, 4095, 4096, 5000, 262144, 300000, 16777216, 20000000};
+  std::vector<TimerNode> nodes(ticks.size());
+  for (size_t i = ticks.size(); i-- > 0;) {
+    nodes[i].expires = ticks[i];
+    wheel.insert(&nodes[i]);
+  }
+  EXPECT_EQ(wheel.size(), ticks.size());
+
+  std::vector<uint64_t> expired;
+  while (!wheel.empty()) {
+    uint64_t next = wheel.next_tick().value();
+    EXPECT_GT(next, wheel.current_tick());
+    auto batch = advance(wheel, next);
+    expired.insert(expired.end(), batch.begin(), batch.end());
+  }
+  EXPECT_EQ(expired, ticks);
+  EXPECT_FALSE(wheel.next_tick().has_value());
+}
+
+TEST(TimerWheelTest, DueTimerExpiresOnNextAdvance) {
+  TimerWheel wheel;
+  advance(wheel, 100);
+  TimerNode node;
+  node.expires = 50;
+  wheel.insert(&node);
+  EXPECT_EQ(wheel.next_tick(), 100);
+  EXPECT_EQ(advance(wheel, 100).size(), 1);
+  EXPECT_FALSE(node.queued());
+}
+
+TEST(TimerWheelTest, Remove) {
+  TimerWheel wheel;
+  TimerNode a, b;
+  a.expires = 10;
+  b.expires = 10000;
+  wheel.insert(&a);
+  wheel.insert(&b);
+  EXPECT_TRUE(wheel.remove(&b));
+  EXPECT_FALSE(wheel.remove(&b));
+  EXPECT_EQ(advance(wheel, 20000), std::vector<uint64_t>{10});
+  EXPECT_FALSE(wheel.remove(&a));
+}
+
+TEST(TimerWheelTest, MillionTimers) {
+  TimerWheel wheel;
+  constexpr size_t kTimers = 1'000'000;
+  std::vector<TimerNode> nodes(kTimers);
+  for (size_t i = 0; i < kTimers; i++) {
+    nodes[i].expires = 1 + (i * 7919) % 100000;
+    wheel.insert(&nodes[i]);
+  }
+  size_t expired = 0;
+  uint64_t last = 0;
+  wheel.advance(100000, [&](TimerNode* node) {
+    EXPECT_GE(node->expires, last);
+    last = node->expires;
+    expired++;
+  });
+  EXPECT_EQ(expired, kTimers);
+  EXPECT_TRUE(wheel.empty());
+}
+
+TEST(SleepTest, SleepFor) {
+  coros::ThreadPool tp{1};
+  auto start = std::chrono::steady_clock::now();
+  coros::Task<int> t = sleep_and_return(std::chrono::milliseconds(20), 5);
+  coros::start_sync(tp, t);
+  EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(20));
+  EXPECT_EQ(t.value(), 5);
+}
+
+TEST(SleepTest, PastDeadlineDoesNotSuspend) {
+  coros::ThreadPool tp{1};
+  coros::Task<void> t = []() -> coros::Task<void> {
+    co_await coros::sleep_until(std::chrono::steady_clock::now() - std::chrono::seconds(1));
+  }();
+  coros::start_sync(tp, t);
+  EXPECT_TRUE(t.has_value());
+}
+
+// Sleeping tasks do not block the worker, so they all wait concurrently.
+TEST(SleepTest, SleepingTasksDoNotBlockWorker) {
+  coros::ThreadPool tp{1};
+  auto start = std::chrono::steady_clock::now();
+  coros::Task<int> t = []() -> coros::Task<int> {
+    std::vector<coros::Task<int>> tasks;
+    for (int i = 0; i < 1000; i++) tasks.push_back(sleep_and_return(std::chrono::milliseconds(50), 1));
+    auto results = co_await coros::wait_tasks(std::move(tasks));
+    int sum = 0;
+    for (auto& result : results) sum += *result;
+    co_return sum;
+  }();
+  coros::start_sync(tp, t);
+  EXPECT_EQ(t.value(), 1000);
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+}
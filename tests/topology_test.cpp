@@ -0,0 +1,54 @@
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "topology.h"
+
+TEST(TopologyTest, ParseCpuList) {
+  EXPECT_EQ(coros::detail::parse_cpu_list("0-3,8,10-11\n"),
+            (std::vector<int>{0, 1, 2, 3, 8, 10, 11}));
+  EXPECT_EQ(coros::detail::parse_cpu_list("5"), (std::vector<int>{5}));
+  EXPECT_TRUE(coros::detail::parse_cpu_list("").empty());
+}
+
+TEST(TopologyTest, AllowedCpus) {
+  EXPECT_FALSE(coros::detail::allowed_cpus().empty());
+}
+
+// Two sockets, two cores per socket, two SMT siblings per core.
+std::vector<coros::detail::CpuInfo> two_socket_topology() {
+  return {
+    {0, 0, 0, 0}, {1, 0, 1, 0}, {2, 1, 0, 1}, {3, 1, 1, 1},
+    {4, 0, 0, 0}, {5, 0, 1, 0}, {6, 1, 0, 1}, {7, 1, 1, 1},
+  };
+}
+
+TEST(TopologyTest, CompactOrder) {
+  EXPECT_EQ(coros::detail::compact_cpu_order(two_socket_topology()),
+            (std::vector<int>{0, 4, 1, 5, 2, 6, 3, 7}));
+}
+
+TEST(TopologyTest, ScatterOrder) {
+  EXPECT_EQ(coros::detail::scatter_cpu_order(two_socket_topology()),
+            (std::vector<int>{0, 2, 1, 3, 4, 6, 5, 7}));
+}
+
+TEST(TopologyTest, CpuDistance) {
+  using coros::detail::CpuDistance;
+  using coros::detail::CpuInfo;
+  // cpu, package, core, node, l3
+  CpuInfo cpu0{0, 0, 0, 0, 0};
+  CpuInfo cpu0_sibling{8, 0, 0, 0, 0};
+  CpuInfo cpu1{1, 0, 1, 0, 0};
+  CpuInfo cpu4{4, 0, 4, 0, 4};
+  CpuInfo remote{16, 1, 0, 1, 16};
+
+  EXPECT_EQ(coros::detail::cpu_distance(cpu0, cpu0_sibling), CpuDistance::SMT_SIBLING);
+  EXPECT_EQ(coros::detail::cpu_distance(cpu0, cpu1), CpuDistance::SHARED_L3);
+  EXPECT_EQ(coros::detail::cpu_distance(cpu0, cpu4), CpuDistance::SAME_NODE);
+  EXPECT_EQ(coros::detail::cpu_distance(cpu0, remote), CpuDistance::REMOTE);
+  // Unpinned workers are not siblings of the CPU on package 0, core 0.
+  CpuInfo unpinned{};
+  EXPECT_EQ(coros::detail::cpu_distance(cpu0, unpinned), CpuDistance::REMOTE);
+  EXPECT_EQ(coros::detail::cpu_distance(unpinned, unpinned), CpuDistance::REMOTE);
+}
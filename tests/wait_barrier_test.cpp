@@ -1,5 +1,8 @@
 #include <gtest/gtest.h>
 
+#include <thread>
+#include <vector>
+
 #include "wait_barrier.h"
 
 TEST(WaitBarrierTest, IntConstruction) {
@@ -14,6 +17,99 @@ TEST(WaitBarrierTest, DecreaseCounter) {
     EXPECT_EQ(barrier.get_continuation(), nullptr);
 }
 
+TEST(WaitBarrierTest, OwnerFinishesAllTasks) {
+  coros::detail::JoinState join_state;
+  coros::detail::thread_join_state = &join_state;
+  int dummy = 0;
+  auto continuation = std::coroutine_handle<>::from_address(&dummy);
+  coros::detail::WaitBarrier barrier(3, continuation);
+  barrier.set_owner(&join_state);
+
+  EXPECT_EQ(barrier.decrement_and_resume(), std::noop_coroutine());
+  EXPECT_EQ(barrier.decrement_and_resume(), std::noop_coroutine());
+  EXPECT_EQ(join_state.pending.size(), 1);
+  // Local tasks do not touch the shared counter.
+  EXPECT_EQ(barrier.remaining_tasks.load(), 3);
+  EXPECT_EQ(barrier.get_counter(), 1);
+  EXPECT_EQ(barrier.decrement_and_resume(), continuation);
+  EXPECT_TRUE(join_state.pending.empty());
+  coros::detail::thread_join_state = nullptr;
+}
+
+TEST(WaitBarrierTest, OwnerFlushesAfterStolenTask) {
+  coros::detail::JoinState join_state;
+  coros::detail::thread_join_state = &join_state;
+  int dummy = 0;
+  auto continuation = std::coroutine_handle<>::from_address(&dummy);
+  coros::detail::WaitBarrier barrier(3, continuation);
+  barrier.set_owner(&join_state);
+
+  EXPECT_EQ(barrier.decrement_and_resume(), std::noop_coroutine());
+  std::coroutine_handle<> stolen_result;
+  std::thread([&]() { stolen_result = barrier.decrement_and_resume(); }).join();
+  EXPECT_EQ(stolen_result, std::noop_coroutine());
+  EXPECT_TRUE(join_state.must_flush());
+
+  // The last local task sees the stolen one in the shared counter.
+  EXPECT_EQ(barrier.decrement_and_resume(), continuation);
+  EXPECT_TRUE(join_state.pending.empty());
+  coros::detail::thread_join_state = nullptr;
+}
+
+TEST(WaitBarrierTest, OwnerFlushLastTaskStolen) {
+  coros::detail::JoinState join_state;
+  coros::detail::thread_join_state = &join_state;
+  int dummy = 0;
+  auto continuation = std::coroutine_handle<>::from_address(&dummy);
+  coros::detail::WaitBarrier barrier(2, continuation);
+  barrier.set_owner(&join_state);
+
+  EXPECT_EQ(barrier.decrement_and_resume(), std::noop_coroutine());
+  std::coroutine_handle<> stolen_result;
+  std::thread([&]() { stolen_result = barrier.decrement_and_resume(); }).join();
+  EXPECT_EQ(stolen_result, std::noop_coroutine());
+
+  // Owner runs out of work and flushes the pending barrier.
+  std::vector<std::coroutine_handle<>> resumed;
+  join_state.flush([&](std::coroutine_handle<> handle) { resumed.push_back(handle); });
+  ASSERT_EQ(resumed.size(), 1);
+  EXPECT_EQ(resumed[0], continuation);
+  EXPECT_FALSE(join_state.must_flush());
+  coros::detail::thread_join_state = nullptr;
+}
+
+TEST(WaitBarrierTest, AsyncContinuationStoredFirst) {
+  int dummy = 0;
+  auto continuation = std::coroutine_handle<>::from_address(&dummy);
+  auto* barrier = new coros::detail::WaitBarrierAsync(2);
+
+  EXPECT_TRUE(barrier->set_continuation(continuation));
+  EXPECT_EQ(barrier->decrement_and_resume(), std::noop_coroutine());
+  EXPECT_EQ(barrier->get_counter(), 1);
+  EXPECT_EQ(barrier->decrement_and_resume(), continuation);
+  EXPECT_TRUE(barrier->is_finished());
+  barrier->release();
+}
+
+TEST(WaitBarrierTest, AsyncTasksFinishFirst) {
+  int dummy = 0;
+  auto continuation = std::coroutine_handle<>::from_address(&dummy);
+  auto* barrier = new coros::detail::WaitBarrierAsync(2);
+
+  EXPECT_EQ(barrier->decrement_and_resume(), std::noop_coroutine());
+  EXPECT_EQ(barrier->decrement_and_resume(), std::noop_coroutine());
+  // Awaiter must not suspend, nobody would resume it.
+  EXPECT_FALSE(barrier->set_continuation(continuation));
+  barrier->release();
+}
+
+TEST(WaitBarrierTest, AsyncReleasedBeforeTasksFinish) {
+  auto* barrier = new coros::detail::WaitBarrierAsync(2);
+  barrier->release();
+  EXPECT_EQ(barrier->decrement_and_resume(), std::noop_coroutine());
+  // The last task deletes the barrier.
+  std::thread([&]() { EXPECT_EQ(barrier->decrement_and_resume(), std::noop_coroutine()); }).join();
+}
 
 /*TEST(WaitBarrierTest, Async) {
 {
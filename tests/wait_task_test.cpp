@@ -1,23 +1,32 @@
 #include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
 #include <thread>
 
+#include "sleep.h"
 #include "wait_tasks.h"
 #include "start_tasks.h"
 #include "thread_pool.h"
 
 
 TEST(WaitTaskTest, SettingPromiseBarrier) {
-  coros::detail::WaitTaskPromise<coros::detail::WaitBarrier> promise = 
-  coros::detail::WaitTaskPromise<coros::detail::WaitBarrier>{};
-  coros::detail::WaitBarrier bar{10, nullptr};
-  promise.set_barrier(&bar);
-  EXPECT_EQ(promise.get_barrier().get_counter(), 10);
+  coros::Task<int> t = []() -> coros::Task<int> {
+      co_return 42;
+  }();
+  coros::detail::WaitBarrier bar{2, nullptr};
+  t.get_handle().promise().set_barrier(&bar);
+  // The finished task decrements the barrier instead of resuming a continuation.
+  t.get_handle().resume();
+  EXPECT_EQ(bar.get_counter(), 1);
+  EXPECT_EQ(*t, 42);
 }
 
 TEST(WaitTaskTest, MoveConstructor) {
   EXPECT_EQ(coros::detail::WaitTask<coros::detail::WaitBarrier>::instance_count(), 0);
   {
-    coros::detail::WaitTask<coros::detail::WaitBarrier> task = []() -> coros::detail::WaitTask<coros::detail::WaitBarrier> {
+    coros::detail::WaitTask<coros::detail::WaitBarrier> task = []() -> coros::Task<void> {
         co_return;
     }();
     EXPECT_EQ(coros::detail::WaitTask<coros::detail::WaitBarrier>::instance_count(), 1);
@@ -30,6 +39,7 @@ TEST(WaitTaskTest, MoveConstructor) {
     EXPECT_EQ(task2.get_handle(), old_handle);
   }
     EXPECT_EQ(coros::detail::WaitTask<coros::detail::WaitBarrier>::instance_count(), 0);
+    EXPECT_EQ(coros::Task<void>::instance_count(), 0);
 }
 
 TEST(WaitTaskTest, WaitTaskDestructor) {
@@ -51,11 +61,11 @@ TEST(WaitTaskTest, WaitTaskDestructor) {
 TEST(WaitTaskTest, Construction) {
   EXPECT_EQ(coros::detail::WaitTask<coros::detail::WaitBarrier>::instance_count(), 0);
   {
-    coros::detail::WaitTask<coros::detail::WaitBarrier> t1 = []() -> coros::detail::WaitTask<coros::detail::WaitBarrier> {
+    coros::detail::WaitTask<coros::detail::WaitBarrier> t1 = []() -> coros::Task<void> {
         co_return;
     }();
 
-    coros::detail::WaitTask<coros::detail::WaitBarrier> t2 = []() -> coros::detail::WaitTask<coros::detail::WaitBarrier> {
+    coros::detail::WaitTask<coros::detail::WaitBarrier> t2 = []() -> coros::Task<void> {
         co_return;
     }();
     EXPECT_EQ(coros::detail::WaitTask<coros::detail::WaitBarrier>::instance_count(), 2);
@@ -156,6 +166,101 @@ TEST(WaitTaskTest, WaitTaskFibonacci) {
   EXPECT_EQ(t.value(), 6765);
 }
 
+TEST(WaitTaskTest, WaitTaskFibonacciHelpFirst) {
+  coros::ThreadPool tp{coros::ThreadPoolOptions{
+      .thread_count = 4, .spawn_policy = coros::SpawnPolicy::HELP_FIRST}};
+  coros::Task<int> t = fib2(20);
+  coros::start_sync(tp, t);
+  EXPECT_EQ(t.value(), 6765);
+}
+
+// With the work-first policy the last task runs on the awaiting worker
+// before any queued task.
+TEST(WaitTaskTest, WorkFirstRunsLastTask) {
+  coros::ThreadPool tp{1};
+  std::vector<int> order;
+
+  coros::Task<void> t = [](std::vector<int>& order) -> coros::Task<void> {
+    auto record = [](std::vector<int>& order, int id) -> coros::Task<void> {
+      order.push_back(id);
+      co_return;
+    };
+    co_await coros::wait_tasks(record(order, 1), record(order, 2), record(order, 3));
+  }(order);
+  coros::start_sync(tp, t);
+
+  ASSERT_EQ(order.size(), 3);
+  EXPECT_EQ(order[0], 3);
+}
+
+TEST(WaitTaskTest, WaitForEmptyVector) {
+  coros::ThreadPool tp{1};
+  coros::Task<int> t = []() -> coros::Task<int> {
+    std::vector<coros::Task<int>> vec;
+    co_await coros::wait_tasks(vec);
+    co_return 1;
+  }();
+  coros::start_sync(tp, t);
+  EXPECT_EQ(t.value(), 1);
+}
+
+TEST(WaitTaskTest, ResultsTuple) {
+  coros::ThreadPool tp{2};
+
+  coros::Task<int> t = []() -> coros::Task<int> {
+    auto number = [](int num) -> coros::Task<int> { co_return num; };
+    auto text = []() -> coros::Task<std::string> { co_return "coros"; };
+    auto fail = []() -> coros::Task<void> {
+      throw std::runtime_error("fail");
+      co_return;
+    };
+
+    auto [a, b, c] = co_await coros::wait_tasks(number(40), text(), fail());
+
+    EXPECT_EQ(*b, "coros");
+    EXPECT_FALSE(c.has_value());
+    EXPECT_THROW(std::rethrow_exception(c.error()), std::runtime_error);
+    co_return *a + b->size() - 3;
+  }();
+  coros::start_sync(tp, t);
+
+  EXPECT_EQ(t.value(), 42);
+}
+
+TEST(WaitTaskTest, ResultsVector) {
+  coros::ThreadPool tp{2};
+
+  coros::Task<int> t = []() -> coros::Task<int> {
+    std::vector<coros::Task<int>> vec;
+    for (int i = 1; i <= 10; i++) {
+      vec.push_back([](int num) -> coros::Task<int> { co_return num; }(i));
+    }
+
+    std::vector<std::expected<int, std::exception_ptr>> results =
+        co_await coros::wait_tasks(std::move(vec));
+
+    int result_sum = 0;
+    for (auto& result : results) result_sum += *result;
+    co_return result_sum;
+  }();
+  coros::start_sync(tp, t);
+
+  EXPECT_EQ(t.value(), 55);
+}
+
+TEST(WaitTaskTest, ResultsOtherPool) {
+  coros::ThreadPool tp1{1};
+  coros::ThreadPool tp2{1};
+
+  coros::Task<int> t = [](coros::ThreadPool& tp2) -> coros::Task<int> {
+    auto [a, b] = co_await coros::wait_tasks(tp2, fib2(10), fib2(11));
+    co_return *a + *b;
+  }(tp2);
+  coros::start_sync(tp1, t);
+
+  EXPECT_EQ(t.value(), 144);
+}
+
 coros::Task<int> moveTaskExecution(coros::ThreadPool& tp, int index) {
   auto t1 = fib2(index);
   auto b =  coros::wait_tasks(tp, t1);
@@ -402,3 +507,58 @@ TEST(WaitTaskTest, WaitTaskAsyncVector) {
 
 
 
+
+namespace {
+
+// Counts the destroyed frames of cancelled tasks.
+coros::Task<void> sleep_until_cancelled(std::atomic<int>& destroyed) {
+  struct Guard {
+    ~Guard() { destroyed++; }
+    std::atomic<int>& destroyed;
+  } guard{destroyed};
+  while (true) {
+    co_await coros::check_cancel();
+    co_await coros::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+coros::Task<int> return_value(int value) { co_return value; }
+
+} // namespace
+
+TEST(WaitTaskTest, WaitForCompleted) {
+  coros::ThreadPool tp{2};
+  coros::Task<coros::WaitStatus> t = []() -> coros::Task<coros::WaitStatus> {
+    co_return co_await coros::wait_tasks_for(std::chrono::seconds(10), return_value(1), return_value(2));
+  }();
+  coros::start_sync(tp, t);
+  EXPECT_EQ(t.value(), coros::WaitStatus::COMPLETED);
+}
+
+TEST(WaitTaskTest, WaitForTimeout) {
+  std::atomic<int> destroyed = 0;
+  coros::ThreadPool tp{2};
+  auto start = std::chrono::steady_clock::now();
+  coros::Task<coros::WaitStatus> t = [](std::atomic<int>& destroyed) -> coros::Task<coros::WaitStatus> {
+    std::vector<coros::Task<void>> tasks;
+    for (int i = 0; i < 4; i++) tasks.push_back(sleep_until_cancelled(destroyed));
+    co_return co_await coros::wait_tasks_for(std::chrono::milliseconds(20), std::move(tasks));
+  }(destroyed);
+  coros::start_sync(tp, t);
+  EXPECT_EQ(t.value(), coros::WaitStatus::TIMEOUT);
+  EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(20));
+  // Cancelled tasks finish and are destroyed in the pool.
+  while (destroyed < 4) std::this_thread::yield();
+  while (coros::detail::WaitTask<coros::detail::WaitForState>::instance_count() > 0) {
+    std::this_thread::yield();
+  }
+}
+
+TEST(WaitTaskTest, WaitForEmpty) {
+  coros::ThreadPool tp{1};
+  coros::Task<coros::WaitStatus> t = []() -> coros::Task<coros::WaitStatus> {
+    co_return co_await coros::wait_tasks_for(std::chrono::milliseconds(1), std::vector<coros::Task<int>>{});
+  }();
+  coros::start_sync(tp, t);
+  EXPECT_EQ(t.value(), coros::WaitStatus::COMPLETED);
+}
@@ -0,0 +1,114 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "start_tasks.h"
+#include "thread_pool.h"
+#include "when_any.h"
+
+namespace {
+
+coros::Task<int> value_task(int value) { co_return value; }
+
+// Runs until it gets a stop request.
+coros::Task<int> until_stopped(std::atomic<bool>& started, std::atomic<bool>& done) {
+  started = true;
+  std::stop_token token = co_await coros::get_stop_token();
+  while (!token.stop_requested()) std::this_thread::yield();
+  done = true;
+  co_return -1;
+}
+
+} // namespace
+
+TEST(WhenAnyTest, FirstFinishedWins) {
+  std::atomic<bool> started = false;
+  std::atomic<bool> done = false;
+  bool loser_started_before_resume = true;
+  coros::ThreadPool tp{1};
+
+  coros::Task<int> t = [](std::atomic<bool>& started, std::atomic<bool>& done,
+                          bool& loser_started) -> coros::Task<int> {
+    auto [index, result] = co_await coros::when_any(until_stopped(started, done), value_task(42));
+    loser_started = started;
+    EXPECT_EQ(index, 1);
+    co_return *result;
+  }(started, done, loser_started_before_resume);
+  coros::start_sync(tp, t);
+
+  EXPECT_EQ(t.value(), 42);
+  // The awaiting task did not wait for the loser.
+  EXPECT_FALSE(loser_started_before_resume);
+  // The loser got the stop request before it started, so it is skipped.
+  // Only t is left once the loser was destroyed.
+  while (coros::Task<int>::instance_count() > 1) std::this_thread::yield();
+  EXPECT_FALSE(started);
+}
+
+// The loser runs inline on the awaiting worker, the winner is stolen by the
+// other worker. The LIFO slot is disabled, so the winner can be stolen.
+TEST(WhenAnyTest, LoserGetsStopRequest) {
+  coros::ThreadPool tp{coros::ThreadPoolOptions{.thread_count = 2, .lifo_slot_cap = 0}};
+  std::atomic<bool> started = false;
+  std::atomic<bool> done = false;
+
+  coros::Task<int> t = [](std::atomic<bool>& started, std::atomic<bool>& done) -> coros::Task<int> {
+    auto [index, result] = co_await coros::when_any(
+        [](std::atomic<bool>& started) -> coros::Task<int> {
+          while (!started) std::this_thread::yield();
+          co_return 7;
+        }(started),
+        until_stopped(started, done));
+    EXPECT_EQ(index, 0);
+    co_return *result;
+  }(started, done);
+  coros::start_sync(tp, t);
+
+  EXPECT_EQ(t.value(), 7);
+  while (!done) std::this_thread::yield();
+}
+
+TEST(WhenAnyTest, Exception) {
+  coros::ThreadPool tp{1};
+
+  coros::Task<void> t = []() -> coros::Task<void> {
+    auto [index, result] = co_await coros::when_any(
+        []() -> coros::Task<void> {
+          throw std::runtime_error("fail");
+          co_return;
+        }());
+    EXPECT_EQ(index, 0);
+    EXPECT_FALSE(result.has_value());
+    EXPECT_THROW(std::rethrow_exception(result.error()), std::runtime_error);
+  }();
+  coros::start_sync(tp, t);
+  EXPECT_TRUE(t.has_value());
+}
+
+TEST(WhenAnyTest, Vector) {
+  coros::ThreadPool tp{4};
+
+  coros::Task<int> t = []() -> coros::Task<int> {
+    std::vector<coros::Task<int>> tasks;
+    for (int i = 0; i < 8; i++) tasks.push_back(value_task(i * 10));
+    auto [index, result] = co_await coros::when_any(std::move(tasks));
+    EXPECT_EQ(*result, static_cast<int>(index) * 10);
+    co_return *result;
+  }();
+  coros::start_sync(tp, t);
+  EXPECT_TRUE(t.has_value());
+}
+
+TEST(WhenAnyTest, EmptyVector) {
+  coros::ThreadPool tp{1};
+
+  coros::Task<bool> t = []() -> coros::Task<bool> {
+    auto result = co_await coros::when_any(std::vector<coros::Task<int>>{});
+    co_return result.result.has_value();
+  }();
+  coros::start_sync(tp, t);
+  EXPECT_FALSE(t.value());
+}
@@ -0,0 +1,101 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "start_tasks.h"
+#include "thread_pool.h"
+#include "wait_tasks.h"
+#include "yield.h"
+
+namespace {
+
+coros::Task<void> set_flag(std::atomic<bool>& flag) {
+  flag = true;
+  co_return;
+}
+
+// Spins on the flag, without yielding the single worker never runs set_flag.
+coros::Task<int> wait_for_flag_yield(std::atomic<bool>& flag) {
+  int rounds = 0;
+  while (!flag) {
+    rounds++;
+    co_await coros::yield();
+  }
+  co_return rounds;
+}
+
+coros::Task<int> wait_for_flag_budget(std::atomic<bool>& flag) {
+  int rounds = 0;
+  while (!flag) {
+    rounds++;
+    co_await coros::consume_budget();
+  }
+  co_return rounds;
+}
+
+} // namespace
+
+// The spinning task runs inline, set_flag waits in the LIFO slot.
+TEST(YieldTest, YieldLetsOtherTasksRun) {
+  coros::ThreadPool tp{1};
+  std::atomic<bool> flag = false;
+  coros::Task<int> spin = wait_for_flag_yield(flag);
+  coros::Task<void> set = set_flag(flag);
+  coros::start_sync(tp, set, spin);
+  EXPECT_EQ(spin.value(), 1);
+}
+
+TEST(YieldTest, BudgetOperations) {
+  coros::ThreadPool tp{coros::ThreadPoolOptions{
+      .thread_count = 1, .budget_operations = 8, .budget_time = std::chrono::microseconds(0)}};
+  std::atomic<bool> flag = false;
+  coros::Task<int> spin = wait_for_flag_budget(flag);
+  coros::Task<void> set = set_flag(flag);
+  coros::start_sync(tp, set, spin);
+  // Yielded after the eighth operation.
+  EXPECT_EQ(spin.value(), 8);
+}
+
+TEST(YieldTest, BudgetTime) {
+  coros::ThreadPool tp{coros::ThreadPoolOptions{
+      .thread_count = 1, .budget_operations = 0, .budget_time = std::chrono::microseconds(100)}};
+  std::atomic<bool> flag = false;
+  coros::Task<int> spin = wait_for_flag_budget(flag);
+  coros::Task<void> set = set_flag(flag);
+  coros::start_sync(tp, set, spin);
+  EXPECT_GE(spin.value(), static_cast<int>(coros::detail::kBudgetClockInterval));
+}
+
+coros::Task<int> wait_for_flag_slow(std::atomic<bool>& flag) {
+  int rounds = 0;
+  while (!flag) {
+    rounds++;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    co_await coros::consume_budget();
+  }
+  co_return rounds;
+}
+
+// The time budget starts with the first operation, so slow operations yield
+// at the first clock check.
+TEST(YieldTest, BudgetTimeFromFirstOperation) {
+  coros::ThreadPool tp{coros::ThreadPoolOptions{
+      .thread_count = 1, .budget_operations = 0, .budget_time = std::chrono::milliseconds(5)}};
+  std::atomic<bool> flag = false;
+  coros::Task<int> spin = wait_for_flag_slow(flag);
+  coros::Task<void> set = set_flag(flag);
+  coros::start_sync(tp, set, spin);
+  EXPECT_EQ(spin.value(), static_cast<int>(coros::detail::kBudgetClockInterval));
+}
+
+// Outside of a pool neither awaitable suspends.
+TEST(YieldTest, OutsideOfPool) {
+  coros::Task<void> t = []() -> coros::Task<void> {
+    co_await coros::yield();
+    for (int i = 0; i < 1000; i++) co_await coros::consume_budget();
+  }();
+  t.get_handle().resume();
+  EXPECT_TRUE(t.get_handle().done());
+}